@@ -0,0 +1,6 @@
+#!/bin/sh
+# Build the sample-log benchmark on Linux.
+set -e
+OUT_DIR=sim
+mkdir -p $OUT_DIR
+g++ -O2 -std=c++20 -I includes logbench.cpp includes/samplelog.cpp includes/runfile.cpp includes/runlog.cpp includes/gorilla.cpp includes/logstore.cpp -o $OUT_DIR/logbench -lpthread
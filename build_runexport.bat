@@ -0,0 +1,9 @@
+@REM Build for Visual Studio compiler. Run your copy of amd64/vcvars32.bat to setup 64-bit command-line compiler.
+
+@set INCLUDES=/I includes
+@set SOURCES=runexport.cpp includes/runfile.cpp includes/gorilla.cpp includes/runlog.cpp includes/logstore.cpp
+
+@set OUT_DIR=Release
+@set OUT_EXE=runexport
+if not exist %OUT_DIR% mkdir %OUT_DIR%
+cl /nologo /Ox /Oi /EHsc /std:c++20 %INCLUDES% %SOURCES% /Fe%OUT_DIR%/%OUT_EXE%.exe /Fo%OUT_DIR%/
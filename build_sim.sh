@@ -0,0 +1,7 @@
+#!/bin/sh
+# Build the instrument simulators on Linux.
+set -e
+OUT_DIR=sim
+mkdir -p $OUT_DIR
+g++ -O2 -std=c++17 -I includes it8512_sim.cpp -o $OUT_DIR/it8512_sim
+g++ -O2 -std=c++17 -I includes psw_sim.cpp -o $OUT_DIR/psw_sim
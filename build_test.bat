@@ -1,11 +1,27 @@
 @REM Build for Visual Studio compiler. Run your copy of amd64/vcvars32.bat to setup 64-bit command-line compiler.
 
 @set INCLUDES=/I includes
-@set SOURCES=test.cpp includes/seriallib.cpp
+@set SOURCES=test.cpp includes/seriallib.cpp includes/it8512parser.cpp
 @set LIBS=/LIBPATH:.  opengl32.lib gdi32.lib shell32.lib
 
 @set OUT_DIR=Debug_test
 @set OUT_EXE=serial_test
 if not exist %OUT_DIR% mkdir %OUT_DIR%
+
+@REM Unit tests; each exits non-zero if a check fails.
+cl /nologo /Zi /MD /EHsc /std:c++20 %INCLUDES% tests\parser_test.cpp includes/it8512parser.cpp /Fe%OUT_DIR%/parser_test.exe /Fo%OUT_DIR%/ || exit /b 1
+%OUT_DIR%\parser_test.exe || exit /b 1
+cl /nologo /Zi /MD /EHsc /std:c++20 %INCLUDES% tests\gorilla_test.cpp includes/gorilla.cpp /Fe%OUT_DIR%/gorilla_test.exe /Fo%OUT_DIR%/ || exit /b 1
+%OUT_DIR%\gorilla_test.exe || exit /b 1
+cl /nologo /Zi /MD /EHsc /std:c++20 %INCLUDES% tests\runfile_test.cpp includes/runfile.cpp includes/gorilla.cpp includes/logstore.cpp /Fe%OUT_DIR%/runfile_test.exe /Fo%OUT_DIR%/ || exit /b 1
+%OUT_DIR%\runfile_test.exe || exit /b 1
+cl /nologo /Zi /MD /EHsc /std:c++20 %INCLUDES% tests\runlog_test.cpp includes/runlog.cpp includes/runfile.cpp includes/gorilla.cpp includes/logstore.cpp /Fe%OUT_DIR%/runlog_test.exe /Fo%OUT_DIR%/ || exit /b 1
+%OUT_DIR%\runlog_test.exe || exit /b 1
+cl /nologo /Zi /MD /EHsc /std:c++20 %INCLUDES% tests\recipe_test.cpp includes/recipe.cpp /Fe%OUT_DIR%/recipe_test.exe /Fo%OUT_DIR%/ || exit /b 1
+%OUT_DIR%\recipe_test.exe || exit /b 1
+cl /nologo /Zi /MD /EHsc /std:c++20 %INCLUDES% tests\ivrefine_test.cpp /Fe%OUT_DIR%/ivrefine_test.exe /Fo%OUT_DIR%/ || exit /b 1
+%OUT_DIR%\ivrefine_test.exe || exit /b 1
+
+@REM Hardware check: polls a load on COM6 until stopped.
 cl /nologo /Zi /MD /Ox /Oi /EHsc /std:c++17 %INCLUDES% %SOURCES% /Fe%OUT_DIR%/%OUT_EXE%.exe /Fo%OUT_DIR%/ /link %LIBS%
 %~dp0/%OUT_DIR%/%OUT_EXE%.exe
\ No newline at end of file
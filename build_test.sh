@@ -0,0 +1,19 @@
+#!/bin/sh
+# Build and run the unit tests on Linux.
+set -e
+OUT_DIR=sim
+mkdir -p $OUT_DIR
+g++ -O2 -std=c++20 -I includes tests/parser_test.cpp includes/it8512parser.cpp -o $OUT_DIR/parser_test
+$OUT_DIR/parser_test
+g++ -O2 -std=c++20 -I includes tests/gorilla_test.cpp includes/gorilla.cpp -o $OUT_DIR/gorilla_test
+$OUT_DIR/gorilla_test
+g++ -O2 -std=c++20 -I includes tests/runfile_test.cpp includes/runfile.cpp includes/gorilla.cpp includes/logstore.cpp -o $OUT_DIR/runfile_test -lpthread
+$OUT_DIR/runfile_test
+g++ -O2 -std=c++20 -I includes tests/recipe_test.cpp includes/recipe.cpp -o $OUT_DIR/recipe_test
+$OUT_DIR/recipe_test
+g++ -O2 -std=c++20 -I includes tests/scpi_test.cpp includes/scpitransport.cpp -o $OUT_DIR/scpi_test -lpthread
+$OUT_DIR/scpi_test
+g++ -O2 -std=c++20 -I includes tests/runlog_test.cpp includes/runlog.cpp includes/runfile.cpp includes/gorilla.cpp includes/logstore.cpp -o $OUT_DIR/runlog_test -lpthread
+$OUT_DIR/runlog_test
+g++ -O2 -std=c++20 -I includes tests/ivrefine_test.cpp -o $OUT_DIR/ivrefine_test
+$OUT_DIR/ivrefine_test
@@ -0,0 +1,107 @@
+﻿#include "acquisition.hpp"
+
+acquisition::acquisition(it8512queue* load, visalib* psw)
+    : load(load), psw(psw), epoch(std::chrono::steady_clock::now()) {}
+
+acquisition::~acquisition() { stop(); }
+
+void acquisition::start() {
+  if (running.exchange(true)) {
+    return;
+  }
+  worker = std::thread(&acquisition::run, this);
+}
+
+void acquisition::stop() {
+  running = false;
+  if (worker.joinable()) {
+    worker.join();
+  }
+}
+
+void acquisition::setFrequency(float freq) { readFreq = freq; }
+
+void acquisition::setMode(int mode) { this->mode = mode; }
+
+bool acquisition::pop(sample& s) { return ring.pop(s); }
+
+double acquisition::now() const {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       epoch)
+      .count();
+}
+
+unsigned long long acquisition::dropped() const { return dropped_count; }
+
+void acquisition::run() {
+  using clock = std::chrono::steady_clock;
+  clock::time_point next = clock::now();
+  float vcp[3] = {0.0f, 0.0f, 0.0f};
+  measurement m;
+  it8512codec::reply r;
+  clock::time_point t_reply;
+  // Time of the last reading turned into a sample; a cached reading is
+  // only reused if it is newer, so no reading is ever sampled twice.
+  clock::time_point consumed;
+  while (running) {
+    const int current_mode = mode;
+    // A reading someone else took within half a period is reused rather
+    // than asked for again.
+    const double max_age = 0.5 / readFreq;
+    sample s;
+    bool read = false;
+    if (current_mode == 1) {
+      // The supply sees the same terminals as the load; one query to it is
+      // the whole sample.
+      const bool reuse = psw->recent(max_age, m) && m.time > consumed;
+      if (reuse || psw->measure(m)) {
+        vcp[0] = m.voltage;
+        vcp[1] = m.current;
+        vcp[2] = m.power;
+        s.time = std::chrono::duration<double>(m.time - epoch).count();
+        consumed = m.time;
+        read = true;
+      }
+    } else {
+      if (!load->recentVCP(max_age, r, t_reply) || t_reply <= consumed) {
+        r = load->readVCP(it8512queue::POLL).get();
+        t_reply = clock::now();
+      }
+      if (!it8512codec::accepted(r) || r.command != it8512codec::READ_VCP) {
+        std::cout << "读取电压、电流、功率失败!" << std::endl;
+      } else {
+        vcp[0] = r.voltage;
+        vcp[1] = r.current;
+        vcp[2] = r.power;
+        s.time = std::chrono::duration<double>(t_reply - epoch).count();
+        consumed = t_reply;
+        read = true;
+      }
+    }
+    s.voltage = vcp[0];
+    s.current = vcp[1];
+    s.power = vcp[2];
+    s.mode = current_mode;
+    if (current_mode == 1) {
+      s.hydrogen = vcp[1] / 26.801 / 2.0 * 23.8 * 20.0;
+    } else {
+      s.hydrogen = 0.0f;
+    }
+    // A failed read yields no sample rather than repeating the last one
+    // under a new timestamp.
+    if (read && !ring.push(s)) {
+      dropped_count++;
+    }
+
+    // Pace against absolute deadlines; if the port is slower than the
+    // requested rate, run back to back instead of accumulating debt.
+    next += std::chrono::duration_cast<clock::duration>(
+        std::chrono::duration<double>(1.0 / readFreq));
+    const clock::time_point t = clock::now();
+    if (next < t) {
+      next = t;
+    } else {
+      std::this_thread::sleep_until(next);
+    }
+  }
+}
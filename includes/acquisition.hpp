@@ -0,0 +1,47 @@
+﻿#pragma once
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "it8512queue.hpp"
+#include "spscring.hpp"
+#include "visalib.hpp"
+
+struct sample {
+  double time;
+  float voltage;
+  float current;
+  float power;
+  float hydrogen;
+  int mode;
+};
+
+// Polls the instruments on its own thread and hands timestamped samples to
+// the UI through a lock-free ring, so the sampling rate does not depend on the
+// frame rate and a slow port never stalls rendering. Polls go out on the
+// lowest-priority lane and reuse a sweep's reading when it is fresh enough
+// and newer than the last one sampled.
+class acquisition {
+ public:
+  acquisition(it8512queue* load, visalib* psw);
+  ~acquisition();
+  void start();
+  void stop();
+  void setFrequency(float freq);
+  void setMode(int mode);
+  bool pop(sample& s);
+  double now() const;
+  unsigned long long dropped() const;
+
+ private:
+  void run();
+  it8512queue* load;
+  visalib* psw;
+  std::thread worker;
+  std::atomic<bool> running{false};
+  std::atomic<float> readFreq{25.0f};
+  std::atomic<int> mode{0};
+  std::atomic<unsigned long long> dropped_count{0};
+  std::chrono::steady_clock::time_point epoch;
+  spscring<sample, 4096> ring;
+};
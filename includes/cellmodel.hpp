@@ -0,0 +1,152 @@
+﻿#pragma once
+#include <cmath>
+#include <random>
+
+// Lumped polarization model of a reversible cell stack, used by the
+// instrument simulators. Positive current is fuel-cell (discharge)
+// operation, negative current is electrolysis.
+//   V(I) = N * (E0 - A * asinh(I / 2i0) - R * I + B * ln(1 - I / iL))
+// The terminal voltage follows the steady-state curve with a first-order lag
+// of time constant tau, which gives sweeps a realistic settling transient.
+struct cellmodel {
+  int cells = 25;
+  double e0 = 1.2;       // open-circuit voltage per cell (V)
+  double tafel = 0.03;   // activation slope A (V)
+  double i0 = 0.05;      // exchange current (A)
+  double r = 0.01;       // ohmic resistance per cell (Ohm)
+  double b = 0.05;       // mass-transport coefficient B (V)
+  double il = 20.0;      // limiting current (A)
+  double tau = 0.5;      // relaxation time constant (s)
+  double noise = 0.0;    // gaussian voltage noise (V, stack level)
+
+  double steadyVoltage(double current) const {
+    double c = current;
+    if (c > il * 0.999) {
+      c = il * 0.999;
+    }
+    if (c < -il * 0.999) {
+      c = -il * 0.999;
+    }
+    // The limiting-current term applies symmetrically to electrolysis.
+    return cells * (e0 - tafel * std::asinh(c / (2.0 * i0)) - r * c +
+                    b * std::log(1.0 - std::fabs(c) / il));
+  }
+
+  // Inverse of steadyVoltage by bisection; V(I) is monotonically decreasing.
+  double steadyCurrent(double voltage) const {
+    double lo = -il * 0.999;
+    double hi = il * 0.999;
+    for (int i = 0; i < 60; i++) {
+      const double mid = 0.5 * (lo + hi);
+      if (steadyVoltage(mid) > voltage) {
+        lo = mid;
+      } else {
+        hi = mid;
+      }
+    }
+    return 0.5 * (lo + hi);
+  }
+
+  // Current a constant-resistance load settles at, where V(I) = I * ohms.
+  // V(I) falls while I * ohms rises, so there is one crossing.
+  double currentAtResistance(double ohms) const {
+    double lo = 0.0;
+    double hi = il * 0.999;
+    for (int i = 0; i < 60; i++) {
+      const double mid = 0.5 * (lo + hi);
+      if (steadyVoltage(mid) > mid * ohms) {
+        lo = mid;
+      } else {
+        hi = mid;
+      }
+    }
+    return 0.5 * (lo + hi);
+  }
+
+  // Current a constant-power load settles at, where V(I) * I = watts. A load
+  // coming from open circuit finds the lower of the two such currents;
+  // above the stack's peak power it stays at the peak.
+  double currentAtPower(double watts) const {
+    double lo = 0.0;
+    double hi = il * 0.999;
+    for (int i = 0; i < 100; i++) {
+      const double a = lo + (hi - lo) / 3.0;
+      const double b = hi - (hi - lo) / 3.0;
+      if (steadyVoltage(a) * a < steadyVoltage(b) * b) {
+        lo = a;
+      } else {
+        hi = b;
+      }
+    }
+    const double peak = 0.5 * (lo + hi);
+    lo = 0.0;
+    hi = peak;
+    for (int i = 0; i < 60; i++) {
+      const double mid = 0.5 * (lo + hi);
+      if (steadyVoltage(mid) * mid < watts) {
+        lo = mid;
+      } else {
+        hi = mid;
+      }
+    }
+    return 0.5 * (lo + hi);
+  }
+};
+
+// Time-stepped state of one simulated stack.
+class cellstate {
+ public:
+  explicit cellstate(const cellmodel& model)
+      : model(model), voltage(model.steadyVoltage(0.0)), current(0.0) {}
+
+  // Advances the lag by dt seconds with the given current drawn from the
+  // stack and returns the terminal voltage.
+  double drawCurrent(double amps, double dt) {
+    current = amps;
+    relax(model.steadyVoltage(amps), dt);
+    return read();
+  }
+
+  // Holds the terminal voltage (CV load or power supply) and returns the
+  // resulting current once the lag has been advanced by dt seconds.
+  double holdVoltage(double volts, double dt) {
+    voltage = volts;
+    current = target_current(volts, dt);
+    return current;
+  }
+
+  double read() {
+    if (model.noise > 0.0) {
+      return voltage + gauss(rng) * model.noise;
+    }
+    return voltage;
+  }
+
+  double lastCurrent() const { return current; }
+  const cellmodel& parameters() const { return model; }
+
+ private:
+  void relax(double target, double dt) {
+    if (model.tau <= 0.0) {
+      voltage = target;
+      return;
+    }
+    voltage = target + (voltage - target) * std::exp(-dt / model.tau);
+  }
+
+  // Under a voltage hold the current settles towards its steady value with
+  // the same time constant.
+  double target_current(double volts, double dt) {
+    const double steady = model.steadyCurrent(volts);
+    if (model.tau <= 0.0) {
+      return steady;
+    }
+    return steady + (current - steady) * std::exp(-dt / model.tau);
+  }
+
+  cellmodel model;
+  double voltage;
+  double current;
+  std::mt19937 rng{12345};
+  std::normal_distribution<double> gauss{0.0, 1.0};
+};
@@ -0,0 +1,122 @@
+﻿#include "checkpoint.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+bool sweepcheckpoint::save(const char* path) const {
+  const std::string temporary = std::string(path) + ".tmp";
+  {
+    std::ofstream out(temporary, std::ios::trunc);
+    if (!out) {
+      std::cout << "无法写入断点文件 " << temporary << "!" << std::endl;
+      return false;
+    }
+    out.precision(9);
+    out << "file " << filename << "\n"
+        << "offset " << offset << "\n"
+        << "pc " << pc << "\n"
+        << "done " << done << "\n"
+        << "added " << added << "\n"
+        << "refine " << refine_budget << "\n"
+        << "mode " << mode << "\n"
+        << "load " << load_type << "\n"
+        << "setpoint " << setpoint << "\n"
+        << "vcp " << vcp[0] << " " << vcp[1] << " " << vcp[2] << "\n"
+        << "plan " << plan << "\n"
+        << "dwell " << dwell.adaptive << " " << dwell.min_dwell << " "
+        << dwell.max_dwell << " " << dwell.window << " " << dwell.threshold
+        << " " << dwell.period << "\n";
+    for (const recipestep& s : steps) {
+      out << "step " << (int)s.code << " " << s.value << " " << s.seconds
+          << " " << (int)s.variable << " " << (int)s.compare << " "
+          << s.target << "\n";
+    }
+    for (size_t i = 0; i < measured_x.size(); i++) {
+      out << "point " << measured_x[i] << " " << measured_y[i] << "\n";
+    }
+    for (float x : rows) {
+      out << "row " << x << "\n";
+    }
+    out << "end\n";
+    if (!out.flush()) {
+      std::cout << "无法写入断点文件 " << temporary << "!" << std::endl;
+      return false;
+    }
+  }
+  std::error_code error;
+  std::filesystem::rename(temporary, path, error);
+  if (error) {
+    std::cout << "无法更新断点文件 " << path << "!" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool sweepcheckpoint::load(const char* path) {
+  std::ifstream in(path);
+  if (!in) {
+    return false;
+  }
+  *this = sweepcheckpoint();
+  std::string key;
+  bool complete = false;
+  while (in >> key) {
+    if (key == "file") {
+      in >> std::ws;
+      std::getline(in, filename);
+    } else if (key == "offset") {
+      in >> offset;
+    } else if (key == "pc") {
+      in >> pc;
+    } else if (key == "done") {
+      in >> done;
+    } else if (key == "added") {
+      in >> added;
+    } else if (key == "refine") {
+      in >> refine_budget;
+    } else if (key == "mode") {
+      in >> mode;
+    } else if (key == "load") {
+      in >> load_type;
+    } else if (key == "setpoint") {
+      in >> setpoint;
+    } else if (key == "vcp") {
+      in >> vcp[0] >> vcp[1] >> vcp[2];
+    } else if (key == "plan") {
+      in >> plan;
+    } else if (key == "dwell") {
+      in >> dwell.adaptive >> dwell.min_dwell >> dwell.max_dwell >>
+          dwell.window >> dwell.threshold >> dwell.period;
+    } else if (key == "step") {
+      recipestep s;
+      int code, variable, compare;
+      in >> code >> s.value >> s.seconds >> variable >> compare >> s.target;
+      s.code = (recipestep::op)code;
+      s.variable = (char)variable;
+      s.compare = (char)compare;
+      steps.push_back(s);
+    } else if (key == "point") {
+      float x, y;
+      in >> x >> y;
+      measured_x.push_back(x);
+      measured_y.push_back(y);
+    } else if (key == "row") {
+      float x;
+      in >> x;
+      rows.push_back(x);
+    } else if (key == "end") {
+      complete = true;
+      break;
+    }
+    if (!in) {
+      break;
+    }
+  }
+  if (!complete || filename.empty() || pc < 0 || pc > (int)steps.size()) {
+    std::cout << "断点文件 " << path << " 不完整!" << std::endl;
+    *this = sweepcheckpoint();
+    return false;
+  }
+  return true;
+}
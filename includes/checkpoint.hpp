@@ -0,0 +1,35 @@
+﻿#pragma once
+#include <string>
+#include <vector>
+
+#include "recipe.hpp"
+#include "steadystate.hpp"
+
+// Where an interrupted sweep stands: the program it runs, the next step,
+// the instrument state to restore and how much of the CSV is complete.
+// It is rewritten after completed steps, so a crash or a dropped port
+// costs at most the steps since the last save.
+struct sweepcheckpoint {
+  std::string filename;  // CSV being written
+  long offset = 0;       // bytes of the CSV covered by this checkpoint
+  int pc = 0;            // next program step
+  int done = 0;          // steps recorded so far
+  int added = 0;         // refinement points recorded so far
+  int refine_budget = 0;
+  int mode = 0;
+  int load_type = 0;
+  float setpoint = 0.0f;
+  float vcp[3] = {0.0f, 0.0f, 0.0f};  // last reading, for conditions
+  double plan = 0.0;     // sweep clock time the next step starts at
+  dwellsettings dwell;
+  std::vector<recipestep> steps;
+  std::vector<float> measured_x;
+  std::vector<float> measured_y;
+  std::vector<float> rows;  // setpoint of each CSV row, in file order
+
+  bool empty() const { return filename.empty(); }
+  // Writes to a temporary file and renames it over `path`, so a crash
+  // mid-save leaves the previous checkpoint intact.
+  bool save(const char* path) const;
+  bool load(const char* path);
+};
@@ -0,0 +1,198 @@
+﻿#include "gorilla.hpp"
+
+#include <bit>
+#include <cstring>
+
+namespace {
+// Delta-of-delta buckets: a prefix of ones closed by a zero, then the value
+// in two's complement. The last bucket needs no closing zero.
+struct bucket {
+  uint64_t prefix;
+  int prefix_bits;
+  int value_bits;
+};
+const bucket buckets[] = {
+    {0x2, 2, 7}, {0x6, 3, 9}, {0xE, 4, 12}, {0x1E, 5, 20}, {0x1F, 5, 64}};
+
+int64_t signExtend(uint64_t value, int bits) {
+  if (bits == 64) {
+    return (int64_t)value;
+  }
+  const uint64_t sign = 1ull << (bits - 1);
+  return (int64_t)((value ^ sign) - sign);
+}
+
+bool fits(int64_t value, int bits) {
+  if (bits == 64) {
+    return true;
+  }
+  const int64_t limit = 1ll << (bits - 1);
+  return value >= -limit && value < limit;
+}
+
+uint64_t mask(int bits) { return bits == 64 ? ~0ull : (1ull << bits) - 1; }
+}  // namespace
+
+void bitwriter::write(uint64_t value, int bits) {
+  while (bits > 0) {
+    if (used == 0) {
+      buffer.push_back(0);
+    }
+    const int space = 8 - used;
+    const int take = bits < space ? bits : space;
+    const uint8_t chunk = (uint8_t)((value >> (bits - take)) & mask(take));
+    buffer.back() |= (uint8_t)(chunk << (space - take));
+    used = (used + take) & 7;
+    bits -= take;
+  }
+}
+
+void bitwriter::clear() {
+  buffer.clear();
+  used = 0;
+}
+
+uint64_t bitreader::read(int bits) {
+  const size_t first = position >> 3;
+  const int offset = (int)(position & 7);
+  if (bits + offset <= 64 && first + 8 <= size) {
+    // Whole word available: one big-endian load instead of a byte loop.
+    uint64_t word = 0;
+    for (int k = 0; k < 8; k++) {
+      word = (word << 8) | data[first + k];
+    }
+    position += bits;
+    return (word << offset) >> (64 - bits);
+  }
+  uint64_t value = 0;
+  while (bits > 0) {
+    const size_t byte = position >> 3;
+    if (byte >= size) {
+      position += bits;
+      return value << bits;
+    }
+    const int space = 8 - (int)(position & 7);
+    const int take = bits < space ? bits : space;
+    value = (value << take) |
+            ((data[byte] >> (space - take)) & (uint8_t)mask(take));
+    position += take;
+    bits -= take;
+  }
+  return value;
+}
+
+void gorillatimes::add(int64_t t) {
+  if (count == 0) {
+    out.write((uint64_t)t, 64);
+  } else {
+    const int64_t d = t - previous;
+    const int64_t dod = d - delta;
+    if (dod == 0) {
+      out.write(0, 1);
+    } else {
+      for (const bucket& b : buckets) {
+        if (fits(dod, b.value_bits)) {
+          out.write(b.prefix, b.prefix_bits);
+          out.write((uint64_t)dod & mask(b.value_bits), b.value_bits);
+          break;
+        }
+      }
+    }
+    delta = d;
+  }
+  previous = t;
+  count++;
+}
+
+void gorillatimes::clear() {
+  out.clear();
+  count = 0;
+  previous = 0;
+  delta = 0;
+}
+
+bool gorillatimes::decode(const uint8_t* data, size_t size, uint32_t count,
+                          int64_t* values) {
+  bitreader in(data, size);
+  int64_t previous = 0;
+  int64_t delta = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    if (i == 0) {
+      previous = (int64_t)in.read(64);
+    } else {
+      int64_t dod = 0;
+      if (in.read(1) != 0) {
+        int ones = 1;
+        while (ones < 5 && in.read(1) != 0) {
+          ones++;
+        }
+        const int bits = buckets[ones - 1].value_bits;
+        dod = signExtend(in.read(bits), bits);
+      }
+      delta += dod;
+      previous += delta;
+    }
+    values[i] = previous;
+  }
+  return !in.overrun();
+}
+
+void gorillafloats::add(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  if (count == 0) {
+    out.write(bits, 32);
+  } else {
+    const uint32_t x = bits ^ previous;
+    if (x == 0) {
+      out.write(0, 1);
+    } else {
+      const int lead = std::countl_zero(x);
+      const int trail = std::countr_zero(x);
+      if (leading >= 0 && lead >= leading && trail >= trailing) {
+        // Fits the previous window: no need to repeat its position.
+        out.write(0x2, 2);
+        out.write(x >> trailing, 32 - leading - trailing);
+      } else {
+        const int length = 32 - lead - trail;
+        out.write(0x3, 2);
+        out.write((uint64_t)lead, 5);
+        out.write((uint64_t)(length - 1), 5);
+        out.write(x >> trail, length);
+        leading = lead;
+        trailing = trail;
+      }
+    }
+  }
+  previous = bits;
+  count++;
+}
+
+void gorillafloats::clear() {
+  out.clear();
+  count = 0;
+  previous = 0;
+  leading = -1;
+  trailing = 0;
+}
+
+bool gorillafloats::decode(const uint8_t* data, size_t size, uint32_t count,
+                           float* values) {
+  bitreader in(data, size);
+  uint32_t previous = 0;
+  int leading = 0;
+  int trailing = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    if (i == 0) {
+      previous = (uint32_t)in.read(32);
+    } else if (in.read(1) != 0) {
+      if (in.read(1) != 0) {
+        leading = (int)in.read(5);
+        trailing = 32 - leading - ((int)in.read(5) + 1);
+      }
+      previous ^= (uint32_t)in.read(32 - leading - trailing) << trailing;
+    }
+    memcpy(&values[i], &previous, sizeof(previous));
+  }
+  return !in.overrun();
+}
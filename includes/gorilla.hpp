@@ -0,0 +1,68 @@
+﻿#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+// Gorilla time-series compression (Pelkonen et al., VLDB 2015) for sample
+// columns. Timestamps are stored as delta-of-deltas, which are zero or a few
+// bits for a steady sampling rate; values are XORed with the previous value,
+// so a repeated reading costs one bit and a small change only its meaningful
+// bits. Encoding is streaming, a value at a time.
+
+// Appends bits most significant first.
+class bitwriter {
+ public:
+  void write(uint64_t value, int bits);
+  const std::vector<uint8_t>& bytes() const { return buffer; }
+  void clear();
+
+ private:
+  std::vector<uint8_t> buffer;
+  int used = 0;  // bits taken in the last byte
+};
+
+class bitreader {
+ public:
+  bitreader(const uint8_t* data, size_t size) : data(data), size(size) {}
+  uint64_t read(int bits);
+  // True once a read went past the end; the values read are then garbage.
+  bool overrun() const { return position > size * 8; }
+
+ private:
+  const uint8_t* data;
+  size_t size;
+  size_t position = 0;
+};
+
+// Timestamps in integer ticks (the run file uses microseconds).
+class gorillatimes {
+ public:
+  void add(int64_t t);
+  const std::vector<uint8_t>& bytes() const { return out.bytes(); }
+  void clear();
+  static bool decode(const uint8_t* data, size_t size, uint32_t count,
+                     int64_t* values);
+
+ private:
+  bitwriter out;
+  uint32_t count = 0;
+  int64_t previous = 0;
+  int64_t delta = 0;
+};
+
+class gorillafloats {
+ public:
+  void add(float value);
+  const std::vector<uint8_t>& bytes() const { return out.bytes(); }
+  void clear();
+  static bool decode(const uint8_t* data, size_t size, uint32_t count,
+                     float* values);
+
+ private:
+  bitwriter out;
+  uint32_t count = 0;
+  uint32_t previous = 0;
+  int leading = -1;  // window of the last written XOR; -1 before the first
+  int trailing = 0;
+};
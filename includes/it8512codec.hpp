@@ -0,0 +1,253 @@
+﻿#pragma once
+#include <stdint.h>
+
+#include <array>
+
+// IT8512 frame codec. Every frame is 26 bytes: 0xAA, address, command,
+// 22 payload bytes (little-endian fields starting at byte 3) and a checksum
+// byte holding the sum of bytes 0-24 modulo 256.
+//
+// Fixed frames are built and checksummed at compile time; parameterized
+// frames start from a compile-time base frame and only add the checksum
+// contribution of the bytes that change. They are constexpr as well, so a
+// frame with a constant setpoint is also built by the compiler.
+class it8512codec {
+ public:
+  typedef std::array<unsigned char, 26> frame;
+
+  enum command : unsigned char {
+    STATUS = 0x12,
+    REMOTE = 0x20,
+    LOAD = 0x21,
+    MAX_VOLTAGE = 0x22,
+    MAX_CURRENT = 0x24,
+    MAX_POWER = 0x26,
+    MODE = 0x28,
+    SET_CURRENT = 0x2A,
+    SET_VOLTAGE = 0x2C,
+    SET_POWER = 0x2E,
+    SET_RESISTANCE = 0x30,
+    LIST_MODE = 0x3A,
+    LIST_REPEAT = 0x3C,
+    LIST_STEPS = 0x3E,
+    LIST_CURRENT = 0x40,
+    LIST_VOLTAGE = 0x42,
+    LIST_POWER = 0x44,
+    LIST_RESISTANCE = 0x46,
+    TRIGGER_SOURCE = 0x58,
+    TRIGGER = 0x5A,
+    FUNCTION = 0x5D,
+    READ_VCP = 0x5F,
+  };
+
+  enum mode : unsigned char { CC = 0, CV = 1, CW = 2, CR = 3 };
+
+  enum function : unsigned char {
+    FIXED = 0,
+    SHORT = 1,
+    TRANSIENT = 2,
+    LIST = 3,
+    BATTERY = 4,
+  };
+
+  enum trigger_source : unsigned char {
+    TRIGGER_MANUAL = 0,
+    TRIGGER_EXTERNAL = 1,
+    TRIGGER_BUS = 2,
+  };
+
+  // A list step lasts at most 65535 * 0.1 ms.
+  static constexpr float list_step_max = 6.5535f;
+
+  // Second byte of a STATUS reply.
+  enum status : unsigned char {
+    OK = 0x80,
+    CHECKSUM_ERROR = 0x90,
+    PARAMETER_ERROR = 0xA0,
+    UNKNOWN_COMMAND = 0xB0,
+    INVALID_COMMAND = 0xC0,
+  };
+
+  static constexpr unsigned char header = 0xAA;
+  static constexpr unsigned char address = 0x00;
+
+  static constexpr unsigned char checksum(const frame& f) {
+    unsigned int sum = 0;
+    for (int i = 0; i < 25; i++) {
+      sum += f[i];
+    }
+    return (unsigned char)(sum % 256);
+  }
+
+  static constexpr frame make(unsigned char cmd, unsigned char b3 = 0,
+                              unsigned char b4 = 0, unsigned char b5 = 0,
+                              unsigned char b6 = 0) {
+    frame f{};
+    f[0] = header;
+    f[1] = address;
+    f[2] = cmd;
+    f[3] = b3;
+    f[4] = b4;
+    f[5] = b5;
+    f[6] = b6;
+    f[25] = checksum(f);
+    return f;
+  }
+
+  // A parameterless (or constant-parameter) command, fully built at compile
+  // time: fixed<LOAD, 1>::value is the "load on" frame.
+  template <unsigned char Cmd, unsigned char B3 = 0>
+  struct fixed {
+    static constexpr frame value = make(Cmd, B3);
+  };
+
+  // Command carrying one 32-bit little-endian value at byte 3.
+  template <unsigned char Cmd>
+  static constexpr frame encode(uint32_t value) {
+    frame f = fixed<Cmd>::value;
+    f[3] = value & 0xFF;
+    f[4] = (value >> 8) & 0xFF;
+    f[5] = (value >> 16) & 0xFF;
+    f[6] = (value >> 24) & 0xFF;
+    f[25] = (unsigned char)(fixed<Cmd>::value[25] + f[3] + f[4] + f[5] + f[6]);
+    return f;
+  }
+
+  // Physical units to instrument counts, as the IT8512 scales them.
+  static constexpr frame current(float amps) {
+    return encode<SET_CURRENT>(counts(amps, 10000.0f));  // 0.1 mA
+  }
+  static constexpr frame voltage(float volts) {
+    return encode<SET_VOLTAGE>(counts(volts, 1000.0f));  // 1 mV
+  }
+  static constexpr frame power(float watts) {
+    return encode<SET_POWER>(counts(watts, 1000.0f));  // 1 mW
+  }
+  static constexpr frame resistance(float ohms) {
+    return encode<SET_RESISTANCE>(counts(ohms, 1000.0f));  // 1 mOhm
+  }
+  static constexpr frame maxVoltage(float volts) {
+    return encode<MAX_VOLTAGE>(counts(volts, 1000.0f));
+  }
+  static constexpr frame maxCurrent(float amps) {
+    return encode<MAX_CURRENT>(counts(amps, 10000.0f));
+  }
+  static constexpr frame maxPower(float watts) {
+    return encode<MAX_POWER>(counts(watts, 1000.0f));
+  }
+
+  // 0 CC, 1 CV, 2 CW, 3 CR.
+  static constexpr frame loadType(int type) {
+    return make(MODE, (unsigned char)(type & 0x03));
+  }
+
+  // Number of steps in the list, u16 at byte 3.
+  static constexpr frame listSteps(uint16_t steps) {
+    return make(LIST_STEPS, steps & 0xFF, steps >> 8);
+  }
+
+  // One list step: step number (u16) at byte 3, setpoint (u32) at byte 5
+  // and step time in 0.1 ms (u16) at byte 9.
+  static constexpr frame listStep(unsigned char cmd, uint16_t step,
+                                  uint32_t value, float seconds) {
+    frame f = make(cmd, step & 0xFF, step >> 8);
+    const uint32_t ticks = counts(seconds, 10000.0f);
+    const uint16_t time = ticks > 0xFFFF ? 0xFFFF : (uint16_t)ticks;
+    f[5] = value & 0xFF;
+    f[6] = (value >> 8) & 0xFF;
+    f[7] = (value >> 16) & 0xFF;
+    f[8] = (value >> 24) & 0xFF;
+    f[9] = time & 0xFF;
+    f[10] = time >> 8;
+    f[25] = checksum(f);
+    return f;
+  }
+  static constexpr frame listCurrent(uint16_t step, float amps,
+                                     float seconds) {
+    return listStep(LIST_CURRENT, step, counts(amps, 10000.0f), seconds);
+  }
+  static constexpr frame listVoltage(uint16_t step, float volts,
+                                     float seconds) {
+    return listStep(LIST_VOLTAGE, step, counts(volts, 1000.0f), seconds);
+  }
+
+  static constexpr uint32_t u32(const unsigned char* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+  }
+
+  static constexpr uint16_t u16(const unsigned char* p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+  }
+
+  struct reply {
+    bool valid;            // header and checksum are correct
+    unsigned char command;
+    unsigned char status;  // STATUS replies only
+    float voltage;         // READ_VCP replies only
+    float current;
+    float power;
+    unsigned char state;   // operation state register
+    uint16_t demand;       // demand state register
+  };
+
+  // True if frame `f` can be the reply to `command`: the load echoes the
+  // command byte or answers with a STATUS frame.
+  static constexpr bool answers(const frame& f, unsigned char command) {
+    return f[2] == command || f[2] == STATUS;
+  }
+
+  // True for a verified reply that is not a rejection.
+  static bool accepted(const reply& r) {
+    return r.valid && (r.command != STATUS || r.status == OK);
+  }
+
+  // Validates and decodes a reply in a single pass over its 26 bytes.
+  static reply decode(const unsigned char* f) {
+    reply r = {};
+    unsigned int sum = 0;
+    for (int i = 0; i < 25; i++) {
+      sum += f[i];
+    }
+    r.command = f[2];
+    r.valid = f[0] == header && (sum & 0xFF) == f[25];
+    if (r.command == STATUS) {
+      r.status = f[3];
+    } else if (r.command == READ_VCP) {
+      r.voltage = u32(f + 3) / 1000.0f;
+      r.current = u32(f + 7) / 10000.0f;
+      r.power = u32(f + 11) / 1000.0f;
+      r.state = f[15];
+      r.demand = u16(f + 16);
+    }
+    return r;
+  }
+
+ private:
+  static constexpr uint32_t counts(float value, float scale) {
+    return value <= 0.0f ? 0u : (uint32_t)(value * scale + 0.5f);
+  }
+};
+
+// The frames seriallib used to spell out by hand.
+static_assert(it8512codec::fixed<it8512codec::REMOTE, 1>::value[25] == 0xCB,
+              "remote");
+static_assert(it8512codec::fixed<it8512codec::REMOTE, 0>::value[25] == 0xCA,
+              "local");
+static_assert(it8512codec::fixed<it8512codec::LOAD, 1>::value[25] == 0xCC,
+              "load on");
+static_assert(it8512codec::fixed<it8512codec::LOAD, 0>::value[25] == 0xCB,
+              "load off");
+static_assert(it8512codec::fixed<it8512codec::MODE, 0>::value[25] == 0xD2,
+              "CC mode");
+static_assert(it8512codec::fixed<it8512codec::MODE, 1>::value[25] == 0xD3,
+              "CV mode");
+static_assert(it8512codec::fixed<it8512codec::READ_VCP>::value[25] == 0x09,
+              "read VCP");
+// 1 A is 10000 counts (0x2710); the incremental checksum matches a full one.
+static_assert(it8512codec::current(1.0f)[3] == 0x10 &&
+                  it8512codec::current(1.0f)[4] == 0x27 &&
+                  it8512codec::current(1.0f)[25] == 0x0B,
+              "1 A");
+static_assert(it8512codec::voltage(23.456f)[25] ==
+                  it8512codec::checksum(it8512codec::voltage(23.456f)),
+              "voltage checksum");
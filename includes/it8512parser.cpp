@@ -0,0 +1,94 @@
+﻿#include "it8512parser.hpp"
+
+#include <string.h>
+
+it8512parser::it8512parser() : length(0), synced(true), count() {}
+
+void it8512parser::feed(const unsigned char* data, unsigned int n) {
+  while (n > 0) {
+    const unsigned int room = sizeof(buffer) - length;
+    const unsigned int chunk = n < room ? n : room;
+    memcpy(buffer + length, data, chunk);
+    length += chunk;
+    data += chunk;
+    n -= chunk;
+    scan();
+  }
+}
+
+void it8512parser::scan() {
+  unsigned int pos = 0;
+  while (length - pos > 0) {
+    if (buffer[pos] != it8512codec::header) {
+      pos++;
+      count.discarded++;
+      synced = false;
+      continue;
+    }
+    if (length - pos < 26) {
+      break;
+    }
+    const unsigned char* f = buffer + pos;
+    if (!it8512codec::decode(f).valid) {
+      // A payload byte that happens to be 0xAA, or a frame with a damaged
+      // byte: skip this header and hunt for the next one.
+      count.corrupted++;
+      synced = false;
+      pos++;
+      continue;
+    }
+    it8512codec::frame frame;
+    memcpy(frame.data(), f, 26);
+    frames.push_back(frame);
+    count.frames++;
+    if (!synced) {
+      count.recovered++;
+      synced = true;
+    }
+    pos += 26;
+  }
+  memmove(buffer, buffer + pos, length - pos);
+  length -= pos;
+}
+
+bool it8512parser::next(it8512codec::frame& frame) {
+  if (frames.empty()) {
+    return false;
+  }
+  frame = frames.front();
+  frames.pop_front();
+  return true;
+}
+
+bool it8512parser::reply(unsigned char command, it8512codec::frame& frame) {
+  while (next(frame)) {
+    if (it8512codec::answers(frame, command)) {
+      return true;
+    }
+    count.stale++;
+  }
+  return false;
+}
+
+void it8512parser::dropPending() {
+  count.stale += frames.size();
+  frames.clear();
+}
+
+unsigned int it8512parser::needed() const {
+  return length < 26 ? 26 - length : 1;
+}
+
+unsigned int it8512parser::buffered() const { return length; }
+
+void it8512parser::countTimeout() {
+  count.timeouts++;
+  // Whatever partial frame is buffered can no longer complete in time.
+  if (length > 0) {
+    count.discarded += length;
+    length = 0;
+    synced = false;
+  }
+}
+
+it8512parser::counters it8512parser::stats() const { return count; }
@@ -0,0 +1,44 @@
+﻿#pragma once
+#include <deque>
+
+#include "it8512codec.hpp"
+
+// Streaming IT8512 frame parser. Accepts bytes in arbitrary chunks, scans for
+// the 0xAA header, verifies the checksum and resynchronizes after dropped or
+// garbage bytes, so one bad byte costs at most the frames it touched.
+class it8512parser {
+ public:
+  struct counters {
+    unsigned long long frames;     // verified frames emitted
+    unsigned long long corrupted;  // header found but checksum wrong
+    unsigned long long discarded;  // bytes skipped while hunting a header
+    unsigned long long recovered;  // first good frame after lost sync
+    unsigned long long stale;      // verified frames nobody was waiting for
+    unsigned long long timeouts;   // reads that ended without a frame
+  };
+
+  it8512parser();
+  void feed(const unsigned char* data, unsigned int length);
+  // Pops the oldest verified frame.
+  bool next(it8512codec::frame& frame);
+  // Pops the reply to a command: a frame echoing the command byte or a
+  // STATUS frame. Other verified frames are late replies to earlier,
+  // timed-out requests and are counted as stale.
+  bool reply(unsigned char command, it8512codec::frame& frame);
+  // Drops frames that arrived before the current request was sent.
+  void dropPending();
+  // Bytes still missing from the frame being assembled (at least 1).
+  unsigned int needed() const;
+  // Bytes of an incomplete frame currently buffered.
+  unsigned int buffered() const;
+  void countTimeout();
+  counters stats() const;
+
+ private:
+  void scan();
+  unsigned char buffer[128];
+  unsigned int length;
+  bool synced;
+  std::deque<it8512codec::frame> frames;
+  counters count;
+};
@@ -0,0 +1,200 @@
+﻿#include "it8512queue.hpp"
+
+#include <memory>
+#include <vector>
+
+it8512queue::it8512queue(seriallib* it8512, int depth)
+    : it8512(it8512), depth(depth < 1 ? 1 : depth) {
+  it8512->setPipelineDepth(depth);
+#ifndef _WIN32
+  if (it8512->async()) {
+    return;
+  }
+#endif
+  worker = std::thread(&it8512queue::run, this);
+}
+
+it8512queue::~it8512queue() {
+#ifndef _WIN32
+  if (it8512->async()) {
+    // Completions still to come call back into this queue.
+    std::unique_lock<std::mutex> lock(mtx);
+    idle.wait(lock, [this]() {
+      return inflight == 0 && requests[SAFETY].empty() &&
+             requests[SWEEP].empty() && requests[POLL].empty();
+    });
+    return;
+  }
+#endif
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    running = false;
+  }
+  cv.notify_all();
+  worker.join();
+}
+
+std::future<it8512codec::reply> it8512queue::submit(
+    const it8512codec::frame& command, lane priority, callback done) {
+  request r;
+  r.command = command;
+  r.done = std::move(done);
+  std::future<it8512codec::reply> f = r.result.get_future();
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    requests[priority].push_back(std::move(r));
+  }
+#ifndef _WIN32
+  if (it8512->async()) {
+    feed();
+    return f;
+  }
+#endif
+  cv.notify_one();
+  return f;
+}
+
+std::future<it8512codec::reply> it8512queue::loadOn(lane priority) {
+  return submit(it8512codec::fixed<it8512codec::LOAD, 1>::value, priority);
+}
+
+std::future<it8512codec::reply> it8512queue::loadOff(lane priority) {
+  return submit(it8512codec::fixed<it8512codec::LOAD, 0>::value, priority);
+}
+
+std::future<it8512codec::reply> it8512queue::setCurrent(float current,
+                                                        lane priority) {
+  return submit(it8512codec::current(current), priority);
+}
+
+std::future<it8512codec::reply> it8512queue::setVoltage(float voltage,
+                                                        lane priority) {
+  return submit(it8512codec::voltage(voltage), priority);
+}
+
+std::future<it8512codec::reply> it8512queue::setLoadType(int load_type,
+                                                         lane priority) {
+  return submit(it8512codec::loadType(load_type), priority);
+}
+
+bool it8512queue::recentVCP(double max_age, it8512codec::reply& r,
+                            std::chrono::steady_clock::time_point& time) {
+  std::lock_guard<std::mutex> lock(mtx);
+  if (!last_vcp.valid ||
+      std::chrono::steady_clock::now() - last_vcp_time >
+          std::chrono::duration<double>(max_age)) {
+    return false;
+  }
+  r = last_vcp;
+  time = last_vcp_time;
+  return true;
+}
+
+std::future<it8512codec::reply> it8512queue::readVCP(lane priority) {
+  return submit(it8512codec::fixed<it8512codec::READ_VCP>::value, priority);
+}
+
+void it8512queue::run() {
+  std::vector<request> batch;
+  std::vector<it8512codec::frame> commands;
+  std::vector<it8512codec::frame> replies;
+  std::unique_ptr<bool[]> ok;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mtx);
+      cv.wait(lock, [this]() {
+        return !running || !requests[SAFETY].empty() ||
+               !requests[SWEEP].empty() || !requests[POLL].empty();
+      });
+      batch.clear();
+      for (int l = SAFETY; l < LANES; l++) {
+        while (!requests[l].empty() && (int)batch.size() < depth) {
+          batch.push_back(std::move(requests[l].front()));
+          requests[l].pop_front();
+        }
+      }
+      if (batch.empty()) {
+        return;
+      }
+    }
+    const int count = (int)batch.size();
+    commands.resize(count);
+    replies.resize(count);
+    ok.reset(new bool[count]);
+    for (int i = 0; i < count; i++) {
+      commands[i] = batch[i].command;
+    }
+    it8512->pipeline(commands.data(), replies.data(), ok.get(), count);
+    const std::chrono::steady_clock::time_point received =
+        std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++) {
+      it8512codec::reply r = {};
+      if (ok[i]) {
+        r = it8512codec::decode(replies[i].data());
+      } else {
+        r.command = commands[i][2];
+      }
+      deliver(batch[i], r, received);
+    }
+  }
+}
+
+void it8512queue::deliver(request& r, const it8512codec::reply& reply,
+                          std::chrono::steady_clock::time_point received) {
+  if (it8512codec::accepted(reply) &&
+      reply.command == it8512codec::READ_VCP) {
+    std::lock_guard<std::mutex> lock(mtx);
+    last_vcp = reply;
+    last_vcp_time = received;
+  }
+  if (r.done) {
+    r.done(reply);
+  }
+  r.result.set_value(reply);
+}
+
+#ifndef _WIN32
+// Hands queued commands to the port, highest-priority lane first, until
+// `depth` are outstanding. Holding the rest back here rather than in the
+// port's queue is what lets a later safety command overtake them. `finished`
+// retires a completed command under the same lock, so the destructor cannot
+// see the queue idle while this is still running.
+void it8512queue::feed(bool finished) {
+  while (true) {
+    std::shared_ptr<transfer> t;
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      if (finished) {
+        inflight--;
+        finished = false;
+      }
+      for (int l = SAFETY; l < LANES && !t && inflight < depth; l++) {
+        if (!requests[l].empty()) {
+          t = std::make_shared<transfer>();
+          t->r = std::move(requests[l].front());
+          requests[l].pop_front();
+        }
+      }
+      if (!t) {
+        idle.notify_all();
+        return;
+      }
+      inflight++;
+    }
+    it8512->transactAsync(t->r.command.data(), t->reply.data(),
+                          [this, t](bool ok) { finish(t, ok); });
+  }
+}
+
+// Runs on the reactor thread.
+void it8512queue::finish(const std::shared_ptr<transfer>& t, bool ok) {
+  it8512codec::reply r = {};
+  if (ok) {
+    r = it8512codec::decode(t->reply.data());
+  } else {
+    r.command = t->r.command[2];
+  }
+  deliver(t->r, r, std::chrono::steady_clock::now());
+  feed(true);
+}
+#endif
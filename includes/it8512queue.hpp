@@ -0,0 +1,77 @@
+﻿#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "it8512codec.hpp"
+#include "seriallib.hpp"
+
+// Asynchronous command queue for the IT8512, and the only path to the port
+// once it is running. Callers get a future (and an optional callback on the
+// queue thread) instead of blocking for a full serial round trip per command;
+// the queue thread sends up to `depth` queued commands as one pipelined batch,
+// taking them from the highest-priority lane first so a safety command never
+// waits behind more than one batch. A port opened with a reactor needs no
+// queue thread: up to `depth` commands at a time are handed to the port's own
+// pipeline and callbacks run on the reactor thread.
+class it8512queue {
+ public:
+  typedef std::function<void(const it8512codec::reply& r)> callback;
+  enum lane { SAFETY, SWEEP, POLL, LANES };
+
+  it8512queue(seriallib* it8512, int depth = 4);
+  ~it8512queue();
+  std::future<it8512codec::reply> submit(const it8512codec::frame& command,
+                                         lane priority = SWEEP,
+                                         callback done = nullptr);
+  std::future<it8512codec::reply> loadOn(lane priority = SWEEP);
+  std::future<it8512codec::reply> loadOff(lane priority = SWEEP);
+  std::future<it8512codec::reply> setCurrent(float current,
+                                             lane priority = SWEEP);
+  std::future<it8512codec::reply> setVoltage(float voltage,
+                                             lane priority = SWEEP);
+  std::future<it8512codec::reply> setLoadType(int load_type,
+                                              lane priority = SWEEP);
+  std::future<it8512codec::reply> readVCP(lane priority = SWEEP);
+  // Latest accepted READ_VCP reply from any lane if it is at most `max_age`
+  // seconds old, so a periodic poller can reuse a sweep's measurement.
+  bool recentVCP(double max_age, it8512codec::reply& r,
+                 std::chrono::steady_clock::time_point& time);
+  // For multi-frame operations (list upload) that batch on the port itself.
+  seriallib* device() { return it8512; }
+
+ private:
+  struct request {
+    it8512codec::frame command;
+    std::promise<it8512codec::reply> result;
+    callback done;
+  };
+  void run();
+#ifndef _WIN32
+  struct transfer {
+    request r;
+    it8512codec::frame reply;
+  };
+  void feed(bool finished = false);
+  void finish(const std::shared_ptr<transfer>& t, bool ok);
+  int inflight = 0;
+  std::condition_variable idle;
+#endif
+  // Records a READ_VCP for recentVCP, runs the callback and sets the future.
+  void deliver(request& r, const it8512codec::reply& reply,
+               std::chrono::steady_clock::time_point received);
+  seriallib* it8512;
+  int depth;
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::deque<request> requests[LANES];
+  it8512codec::reply last_vcp = {};
+  std::chrono::steady_clock::time_point last_vcp_time;
+  bool running = true;
+  std::thread worker;
+};
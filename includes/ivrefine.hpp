@@ -0,0 +1,59 @@
+﻿#pragma once
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Picks where to add setpoints to a measured curve, given its points sorted
+// by setpoint. Both axes are normalized to their range; each interval is
+// scored by how sharply the curve turns at its two ends times its length,
+// so long intervals across the activation and mass-transport knees are split
+// first and the linear ohmic region is left coarse. Returns the midpoints of
+// up to `budget` intervals, in setpoint order.
+inline std::vector<float> refineSetpoints(const std::vector<float>& x,
+                                          const std::vector<float>& y,
+                                          int budget) {
+  std::vector<float> added;
+  const int n = (int)x.size();
+  if (n < 3 || budget <= 0) {
+    return added;
+  }
+  const auto x_range = std::minmax_element(x.begin(), x.end());
+  const auto y_range = std::minmax_element(y.begin(), y.end());
+  const float x_span = *x_range.second - *x_range.first;
+  const float y_span = *y_range.second - *y_range.first;
+  if (x_span <= 0.0f || y_span <= 0.0f) {
+    return added;
+  }
+  // Direction of each segment and the turn at each interior point.
+  std::vector<float> angle(n - 1);
+  std::vector<float> length(n - 1);
+  for (int i = 0; i < n - 1; i++) {
+    const float dx = (x[i + 1] - x[i]) / x_span;
+    const float dy = (y[i + 1] - y[i]) / y_span;
+    angle[i] = std::atan2(dy, dx);
+    length[i] = std::sqrt(dx * dx + dy * dy);
+  }
+  std::vector<float> turn(n, 0.0f);
+  for (int i = 1; i < n - 1; i++) {
+    turn[i] = std::fabs(angle[i] - angle[i - 1]);
+  }
+  std::vector<int> order(n - 1);
+  std::vector<float> score(n - 1);
+  for (int i = 0; i < n - 1; i++) {
+    order[i] = i;
+    score[i] = (turn[i] + turn[i + 1]) * length[i];
+  }
+  std::sort(order.begin(), order.end(),
+            [&score](int a, int b) { return score[a] > score[b]; });
+  // Intervals that barely bend are not worth a slow step even within budget.
+  const float min_score = 0.01f;
+  for (int j = 0; j < (int)order.size() && (int)added.size() < budget; j++) {
+    const int i = order[j];
+    if (score[i] < min_score) {
+      break;
+    }
+    added.push_back(0.5f * (x[i] + x[i + 1]));
+  }
+  std::sort(added.begin(), added.end());
+  return added;
+}
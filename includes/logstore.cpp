@@ -0,0 +1,351 @@
+﻿#include "logstore.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <vector>
+
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace {
+std::atomic<logstore::backend> chosen{logstore::BUFFERED};
+}  // namespace
+
+class filestore : public logstore {
+ public:
+  ~filestore() {
+    if (fp) {
+      fclose(fp);
+    }
+  }
+
+  bool open(const std::string& path, bool truncate) {
+    fp = fopen(path.c_str(), truncate ? "wb" : "ab");
+    if (!fp) {
+      return false;
+    }
+#ifdef _WIN32
+    _fseeki64(fp, 0, SEEK_END);
+    bytes = _ftelli64(fp);
+#else
+    fseeko(fp, 0, SEEK_END);
+    bytes = ftello(fp);
+#endif
+    return true;
+  }
+
+  bool write(const void* data, size_t size) override {
+    bytes += size;
+    return fwrite(data, 1, size, fp) == size;
+  }
+
+  bool flush() override { return fflush(fp) == 0; }
+
+  bool sync() override { return flush(); }
+
+  long long size() const override { return bytes; }
+
+ private:
+  FILE* fp = NULL;
+  long long bytes = 0;
+};
+
+#ifdef __linux__
+// io_uring through the raw system calls, so nothing beyond the kernel
+// headers is needed. Writes fill one of a few fixed buffers registered with
+// the kernel; a full buffer is queued as a write at its file offset, and all
+// queued writes go to the kernel in one io_uring_enter on flush(); sync()
+// also waits for their completions. A buffer is reused once its completion
+// has been reaped.
+class uringstore : public logstore {
+ public:
+  static const unsigned buffer_count = 8;
+  static const size_t buffer_size = 256 * 1024;
+
+  ~uringstore() {
+    if (fd >= 0) {
+      sync();
+      ::close(fd);
+    }
+    if (sqes && sqes != MAP_FAILED) {
+      munmap(sqes, sq_entries * sizeof(io_uring_sqe));
+    }
+    if (cq_ptr && cq_ptr != MAP_FAILED && cq_ptr != sq_ptr) {
+      munmap(cq_ptr, cq_bytes);
+    }
+    if (sq_ptr) {
+      munmap(sq_ptr, sq_bytes);
+    }
+    if (ring >= 0) {
+      ::close(ring);
+    }
+  }
+
+  bool open(const std::string& path, bool truncate) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring = (int)syscall(__NR_io_uring_setup, 2 * buffer_count, &params);
+    if (ring < 0) {
+      return false;
+    }
+    sq_entries = params.sq_entries;
+    sq_bytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_bytes =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single && cq_bytes > sq_bytes) {
+      sq_bytes = cq_bytes;
+    }
+    sq_ptr = mmap(NULL, sq_bytes, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+    if (sq_ptr == MAP_FAILED) {
+      sq_ptr = NULL;
+      return false;
+    }
+    cq_ptr = single ? sq_ptr
+                    : mmap(NULL, cq_bytes, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+    sqes = (io_uring_sqe*)mmap(NULL, sq_entries * sizeof(io_uring_sqe),
+                               PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_POPULATE, ring,
+                               IORING_OFF_SQES);
+    if (cq_ptr == MAP_FAILED || sqes == MAP_FAILED) {
+      return false;
+    }
+    char* sq = (char*)sq_ptr;
+    char* cq = (char*)cq_ptr;
+    sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    sq_mask = *(unsigned*)(sq + params.sq_off.ring_mask);
+    sq_array = (unsigned*)(sq + params.sq_off.array);
+    cq_head = (unsigned*)(cq + params.cq_off.head);
+    cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    cq_mask = *(unsigned*)(cq + params.cq_off.ring_mask);
+    cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    // Registered buffers save the kernel mapping them on every write; where
+    // the locked-memory limit does not allow it, plain writes still work.
+    buffers.resize(buffer_count);
+    iovec vectors[buffer_count];
+    for (unsigned i = 0; i < buffer_count; i++) {
+      buffers[i].data.resize(buffer_size);
+      vectors[i].iov_base = buffers[i].data.data();
+      vectors[i].iov_len = buffer_size;
+    }
+    fixed = syscall(__NR_io_uring_register, ring, IORING_REGISTER_BUFFERS,
+                    vectors, buffer_count) == 0;
+
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | (truncate ? O_TRUNC : 0),
+                0644);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st;
+    fstat(fd, &st);
+    bytes = st.st_size;
+    return true;
+  }
+
+  bool write(const void* data, size_t size) override {
+    const char* p = (const char*)data;
+    while (size > 0 && !failed) {
+      slot& b = buffers[current];
+      const size_t take = (std::min)(size, buffer_size - b.used);
+      memcpy(b.data.data() + b.used, p, take);
+      b.used += take;
+      bytes += take;
+      p += take;
+      size -= take;
+      if (b.used == buffer_size && !next()) {
+        return false;
+      }
+    }
+    return !failed;
+  }
+
+  bool flush() override {
+    if (buffers[current].used > 0 && !next()) {
+      return false;
+    }
+    if (queued > 0) {
+      enter(0);
+    }
+    while (reap(false)) {
+    }
+    return !failed;
+  }
+
+  bool sync() override {
+    if (!flush()) {
+      return false;
+    }
+    while (in_flight > 0 && reap(true)) {
+    }
+    return !failed && in_flight == 0;
+  }
+
+  long long size() const override { return bytes; }
+
+ private:
+  struct slot {
+    std::vector<char> data;
+    size_t used = 0;  // bytes filled
+    size_t done = 0;  // bytes the kernel has written
+    long long offset = 0;
+    bool busy = false;
+  };
+
+  // Queues the current buffer and moves to a free one, waiting for a
+  // completion only when every buffer is in flight.
+  bool next() {
+    slot& b = buffers[current];
+    b.offset = bytes - (long long)b.used;
+    b.done = 0;
+    b.busy = true;
+    in_flight++;
+    queue(current);
+    for (;;) {
+      for (unsigned k = 1; k <= buffer_count; k++) {
+        const unsigned i = (current + k) % buffer_count;
+        if (!buffers[i].busy) {
+          current = i;
+          buffers[i].used = 0;
+          return true;
+        }
+      }
+      if (queued > 0) {
+        enter(0);
+      }
+      if (!reap(true)) {
+        return false;
+      }
+    }
+  }
+
+  void queue(unsigned i) {
+    slot& b = buffers[i];
+    const unsigned tail = *sq_tail;
+    const unsigned index = tail & sq_mask;
+    io_uring_sqe* sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->off = (unsigned long long)(b.offset + (long long)b.done);
+    sqe->addr = (unsigned long long)(b.data.data() + b.done);
+    sqe->len = (unsigned)(b.used - b.done);
+    sqe->buf_index = fixed ? (unsigned short)i : 0;
+    sqe->user_data = i;
+    sq_array[index] = index;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    queued++;
+  }
+
+  void enter(unsigned wait) {
+    const int submitted =
+        (int)syscall(__NR_io_uring_enter, ring, queued, wait,
+                     wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    if (submitted > 0) {
+      queued -= (unsigned)submitted;
+    }
+  }
+
+  // Handles one completion; if `wait`, blocks for it. Returns false if
+  // there was none or the ring failed.
+  bool reap(bool wait) {
+    unsigned head = *cq_head;
+    if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+      if (!wait || in_flight == 0) {
+        return false;
+      }
+      enter(1);
+      head = *cq_head;
+      if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+        if (errno != EINTR) {
+          failed = true;
+        }
+        return !failed;
+      }
+    }
+    const io_uring_cqe& cqe = cqes[head & cq_mask];
+    const unsigned i = (unsigned)cqe.user_data;
+    const int res = cqe.res;
+    __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+    slot& b = buffers[i];
+    if (res < 0) {
+      std::cout << "写入日志失败: " << strerror(-res) << std::endl;
+      failed = true;
+      b.busy = false;
+      in_flight--;
+    } else if (b.done + res < b.used) {
+      // Short write: queue the rest.
+      b.done += res;
+      queue(i);
+      enter(0);
+    } else {
+      b.busy = false;
+      in_flight--;
+    }
+    return true;
+  }
+
+  int ring = -1;
+  int fd = -1;
+  unsigned sq_entries = 0;
+  size_t sq_bytes = 0;
+  size_t cq_bytes = 0;
+  void* sq_ptr = NULL;
+  void* cq_ptr = NULL;
+  io_uring_sqe* sqes = NULL;
+  unsigned* sq_tail = NULL;
+  unsigned sq_mask = 0;
+  unsigned* sq_array = NULL;
+  unsigned* cq_head = NULL;
+  unsigned* cq_tail = NULL;
+  unsigned cq_mask = 0;
+  io_uring_cqe* cqes = NULL;
+  bool fixed = false;
+  bool failed = false;
+  std::vector<slot> buffers;
+  unsigned current = 0;
+  unsigned queued = 0;     // SQEs not yet submitted
+  unsigned in_flight = 0;  // buffers waiting for their completion
+  long long bytes = 0;
+};
+#endif
+
+void logstore::select(backend b) { chosen = b; }
+
+logstore::backend logstore::selected() { return chosen; }
+
+logstore* logstore::open(const std::string& path, bool truncate) {
+#ifdef __linux__
+  if (chosen == URING) {
+    uringstore* store = new uringstore();
+    if (store->open(path, truncate)) {
+      return store;
+    }
+    delete store;
+    static std::atomic<bool> warned{false};
+    if (!warned.exchange(true)) {
+      std::cout << "io_uring 不可用, 日志改用普通写入!" << std::endl;
+    }
+  }
+#endif
+  filestore* store = new filestore();
+  if (!store->open(path, truncate)) {
+    delete store;
+    return nullptr;
+  }
+  return store;
+}
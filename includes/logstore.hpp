@@ -0,0 +1,33 @@
+﻿#pragma once
+#include <stddef.h>
+
+#include <string>
+
+// Append-only file the sample log writes through. The default backend is a
+// buffered stdio file. On Linux the writes can instead go through io_uring:
+// the writer copies a batch into a registered buffer, queues it and returns
+// to its ring without waiting for the disk.
+class logstore {
+ public:
+  enum backend { BUFFERED, URING };
+
+  virtual ~logstore() {}
+  // Appends at the end of the file; `data` can be reused on return.
+  virtual bool write(const void* data, size_t size) = 0;
+  // Hands everything written so far to the operating system without
+  // waiting for writes still in flight.
+  virtual bool flush() = 0;
+  // Like flush(), but returns only once every write so far has completed,
+  // so the bytes can be read back from the file.
+  virtual bool sync() = 0;
+  // Bytes in the file, counting writes still in flight.
+  virtual long long size() const = 0;
+
+  // Backend for the files opened from now on. URING falls back to BUFFERED
+  // where io_uring is unavailable: not Linux, an old kernel, or blocked.
+  static void select(backend b);
+  static backend selected();
+  // Opens `path` for appending, emptying it first if `truncate`. Returns
+  // nullptr if the file cannot be opened.
+  static logstore* open(const std::string& path, bool truncate);
+};
@@ -0,0 +1,200 @@
+﻿#include "reactor.hpp"
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <iostream>
+
+reactor::reactor() {
+  epfd = epoll_create1(EPOLL_CLOEXEC);
+  wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (epfd < 0 || wakefd < 0 || timerfd < 0) {
+    std::cout << "创建事件循环失败!" << std::endl;
+    return;
+  }
+  epoll_event ev = {};
+  ev.events = EPOLLIN;
+  ev.data.fd = wakefd;
+  epoll_ctl(epfd, EPOLL_CTL_ADD, wakefd, &ev);
+  ev.data.fd = timerfd;
+  epoll_ctl(epfd, EPOLL_CTL_ADD, timerfd, &ev);
+}
+
+reactor::~reactor() {
+  close(timerfd);
+  close(wakefd);
+  close(epfd);
+}
+
+bool reactor::add(int fd, uint32_t events, handler h) {
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    handlers[fd] = std::move(h);
+  }
+  epoll_event ev = {};
+  ev.events = events;
+  ev.data.fd = fd;
+  if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+    std::lock_guard<std::mutex> lock(mtx);
+    handlers.erase(fd);
+    return false;
+  }
+  return true;
+}
+
+bool reactor::modify(int fd, uint32_t events) {
+  epoll_event ev = {};
+  ev.events = events;
+  ev.data.fd = fd;
+  return epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) == 0;
+}
+
+void reactor::remove(int fd) {
+  epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+  std::lock_guard<std::mutex> lock(mtx);
+  handlers.erase(fd);
+}
+
+void reactor::post(std::function<void()> fn) {
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    posted.push_back(std::move(fn));
+  }
+  wake();
+}
+
+int reactor::addTimer(clock::time_point deadline, std::function<void()> fn) {
+  int id;
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    id = next_timer++;
+    timers[id] = std::make_pair(deadline, std::move(fn));
+    deadlines.insert(std::make_pair(deadline, id));
+    armTimer();
+  }
+  return id;
+}
+
+int reactor::addTimer(double seconds, std::function<void()> fn) {
+  return addTimer(clock::now() + std::chrono::duration_cast<clock::duration>(
+                                     std::chrono::duration<double>(seconds)),
+                  std::move(fn));
+}
+
+void reactor::cancelTimer(int id) {
+  std::lock_guard<std::mutex> lock(mtx);
+  auto it = timers.find(id);
+  if (it == timers.end()) {
+    return;
+  }
+  auto range = deadlines.equal_range(it->second.first);
+  for (auto d = range.first; d != range.second; ++d) {
+    if (d->second == id) {
+      deadlines.erase(d);
+      break;
+    }
+  }
+  timers.erase(it);
+}
+
+// Called with mtx held. timerfd gives nanosecond resolution, so timers are
+// not rounded up to epoll_wait's millisecond timeout.
+void reactor::armTimer() {
+  itimerspec spec = {};
+  if (!deadlines.empty()) {
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  deadlines.begin()->first.time_since_epoch())
+                  .count();
+    if (ns <= 0) {
+      ns = 1;
+    }
+    spec.it_value.tv_sec = ns / 1000000000;
+    spec.it_value.tv_nsec = ns % 1000000000;
+  }
+  timerfd_settime(timerfd, TFD_TIMER_ABSTIME, &spec, NULL);
+}
+
+void reactor::fireTimers() {
+  uint64_t expirations;
+  while (read(timerfd, &expirations, sizeof(expirations)) > 0) {
+  }
+  const clock::time_point t = clock::now();
+  std::vector<std::function<void()>> due;
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    while (!deadlines.empty() && deadlines.begin()->first <= t) {
+      auto it = timers.find(deadlines.begin()->second);
+      due.push_back(std::move(it->second.second));
+      timers.erase(it);
+      deadlines.erase(deadlines.begin());
+    }
+    armTimer();
+  }
+  for (auto& fn : due) {
+    fn();
+  }
+}
+
+void reactor::wake() {
+  uint64_t one = 1;
+  if (write(wakefd, &one, sizeof(one)) < 0) {
+    // The counter is already non-zero; the loop will wake anyway.
+  }
+}
+
+void reactor::run() {
+  running = true;
+  while (running) {
+    runOnce(-1);
+  }
+}
+
+void reactor::stop() {
+  running = false;
+  wake();
+}
+
+bool reactor::inLoopThread() const {
+  return std::this_thread::get_id() == loop_thread;
+}
+
+void reactor::runOnce(int timeout_ms) {
+  loop_thread = std::this_thread::get_id();
+  epoll_event events[32];
+  const int n = epoll_wait(epfd, events, 32, timeout_ms);
+  for (int i = 0; i < n; i++) {
+    const int fd = events[i].data.fd;
+    if (fd == wakefd) {
+      uint64_t count;
+      while (read(wakefd, &count, sizeof(count)) > 0) {
+      }
+      continue;
+    }
+    if (fd == timerfd) {
+      fireTimers();
+      continue;
+    }
+    handler h;
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      auto it = handlers.find(fd);
+      if (it == handlers.end()) {
+        continue;
+      }
+      h = it->second;
+    }
+    h(events[i].events);
+  }
+  std::vector<std::function<void()>> work;
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    work.swap(posted);
+  }
+  for (auto& fn : work) {
+    fn();
+  }
+}
+#endif
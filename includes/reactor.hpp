@@ -0,0 +1,71 @@
+﻿#pragma once
+#ifdef __linux__
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Single-threaded epoll event loop. One reactor thread can service any number
+// of non-blocking serial ports and sockets; handlers and timers run on the
+// thread that calls run(). add/remove/post/addTimer may be called from any
+// thread.
+class reactor {
+ public:
+  typedef std::function<void(uint32_t events)> handler;
+  typedef std::chrono::steady_clock clock;
+
+  reactor();
+  ~reactor();
+  bool add(int fd, uint32_t events, handler h);
+  bool modify(int fd, uint32_t events);
+  void remove(int fd);
+  void post(std::function<void()> fn);
+  int addTimer(clock::time_point deadline, std::function<void()> fn);
+  int addTimer(double seconds, std::function<void()> fn);
+  void cancelTimer(int id);
+  void run();
+  void stop();
+  // Waits at most timeout_ms (-1 = forever) and dispatches whatever is ready.
+  void runOnce(int timeout_ms);
+  bool inLoopThread() const;
+
+ private:
+  void wake();
+  void armTimer();
+  void fireTimers();
+  int epfd = -1;
+  int wakefd = -1;
+  int timerfd = -1;
+  std::atomic<bool> running{false};
+  std::thread::id loop_thread;
+  std::mutex mtx;
+  std::unordered_map<int, handler> handlers;
+  std::vector<std::function<void()>> posted;
+  std::multimap<clock::time_point, int> deadlines;
+  std::unordered_map<int, std::pair<clock::time_point, std::function<void()>>>
+      timers;
+  int next_timer = 1;
+};
+
+// A reactor running on its own thread for as long as this object lives. All
+// stations' load ports share one; it must outlive every port added to it.
+class reactorthread {
+ public:
+  reactorthread() : worker([this]() { loop.run(); }) {}
+  ~reactorthread() {
+    loop.post([this]() { loop.stop(); });
+    worker.join();
+  }
+  reactor* get() { return &loop; }
+
+ private:
+  reactor loop;
+  std::thread worker;
+};
+#endif
@@ -0,0 +1,240 @@
+﻿#include "recipe.hpp"
+
+#include <stdlib.h>
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+bool recipe::load(const char* path) {
+  std::ifstream in(path);
+  if (!in) {
+    std::cout << "无法打开配方文件 " << path << "!" << std::endl;
+    return false;
+  }
+  return compile(in);
+}
+
+bool recipe::compile(std::istream& in) {
+  std::vector<line> lines;
+  std::string text;
+  int number = 0;
+  while (std::getline(in, text)) {
+    number++;
+    const size_t comment = text.find('#');
+    if (comment != std::string::npos) {
+      text.erase(comment);
+    }
+    std::istringstream words(text);
+    line l;
+    l.number = number;
+    std::string word;
+    while (words >> word) {
+      l.words.push_back(word);
+    }
+    if (!l.words.empty()) {
+      lines.push_back(l);
+    }
+  }
+  steps.clear();
+  size_t pos = 0;
+  if (!emit(lines, pos, 0, nullptr)) {
+    steps.clear();
+    return false;
+  }
+  // stop_if jumps past the last step.
+  for (recipestep& s : steps) {
+    if (s.code == recipestep::JUMP_IF && s.target < 0) {
+      s.target = (int)steps.size();
+    }
+  }
+  return true;
+}
+
+// Emits lines from pos up to the matching "end" (depth > 0) or the end of
+// the file. `breaks` collects the jumps of break_if in the enclosing repeat.
+bool recipe::emit(const std::vector<line>& lines, size_t& pos, int depth,
+                  std::vector<size_t>* breaks) {
+  while (pos < lines.size()) {
+    const line& l = lines[pos];
+    const std::string& op = l.words[0];
+    const size_t args = l.words.size() - 1;
+    auto number = [&l](size_t i) { return (float)atof(l.words[i].c_str()); };
+    auto fail = [&l](const char* message) {
+      std::cout << "配方第 " << l.number << " 行: " << message << std::endl;
+      return false;
+    };
+    pos++;
+    if (op == "end") {
+      if (depth == 0) {
+        return fail("多余的 end");
+      }
+      return true;
+    } else if (op == "mode" && args == 1) {
+      if (l.words[1] != "fc" && l.words[1] != "ec") {
+        return fail("mode 只能是 fc 或 ec");
+      }
+      steps.push_back(recipestep{recipestep::MODE,
+                                 l.words[1] == "ec" ? 1.0f : 0.0f, 0.0f, 0,
+                                 0, 0});
+    } else if (op == "load" && args == 1) {
+      if (l.words[1] != "cc" && l.words[1] != "cv") {
+        return fail("load 只能是 cc 或 cv");
+      }
+      steps.push_back(recipestep{recipestep::LOAD,
+                                 l.words[1] == "cv" ? 1.0f : 0.0f, 0.0f, 0,
+                                 0, 0});
+    } else if (op == "set" && args == 2) {
+      set(number(1), number(2));
+    } else if (op == "hold" && args == 1) {
+      steps.push_back(
+          recipestep{recipestep::HOLD, 0.0f, number(1), 0, 0, 0});
+    } else if ((op == "ramp" || op == "switch") && args == 4) {
+      const float a = number(1);
+      const float b = number(2);
+      const int n = atoi(l.words[3].c_str());
+      if (n < 1) {
+        return fail("点数必须大于 0");
+      }
+      std::vector<float> levels;
+      for (int i = 0; i < n + 1; i++) {
+        levels.push_back((b - a) / n * i + a);
+      }
+      if (op == "ramp") {
+        for (float level : levels) {
+          set(level, number(4));
+        }
+      } else {
+        for (size_t i = 0; i < levels.size(); i++) {
+          for (size_t j = i + 1; j < levels.size(); j++) {
+            set(levels[i], number(4));
+            set(levels[j], number(4));
+            set(levels[i], number(4));
+          }
+        }
+      }
+    } else if (op == "repeat" && args == 1) {
+      const int times = atoi(l.words[1].c_str());
+      if (times < 1) {
+        return fail("重复次数必须大于 0");
+      }
+      const size_t body = pos;
+      std::vector<size_t> loop_breaks;
+      for (int n = 0; n < times; n++) {
+        pos = body;
+        if (!emit(lines, pos, depth + 1, &loop_breaks)) {
+          return false;
+        }
+      }
+      for (size_t i : loop_breaks) {
+        steps[i].target = (int)steps.size();
+      }
+    } else if ((op == "break_if" || op == "stop_if") && args == 3) {
+      recipestep s = {recipestep::JUMP_IF, 0.0f, 0.0f, 0, 0, 0};
+      if (!condition(l, s)) {
+        return false;
+      }
+      if (op == "break_if") {
+        if (breaks == nullptr) {
+          return fail("break_if 必须在 repeat 之内");
+        }
+        breaks->push_back(steps.size());
+      } else {
+        s.target = -1;
+      }
+      steps.push_back(s);
+    } else {
+      return fail("无法识别的指令");
+    }
+  }
+  if (depth > 0) {
+    std::cout << "配方缺少 end!" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool recipe::condition(const line& l, recipestep& s) {
+  const std::string& variable = l.words[1];
+  const std::string& compare = l.words[2];
+  if ((variable != "V" && variable != "I" && variable != "P") ||
+      (compare != "<" && compare != ">")) {
+    std::cout << "配方第 " << l.number << " 行: 条件应为 V|I|P <|> 数值"
+              << std::endl;
+    return false;
+  }
+  s.variable = variable[0];
+  s.compare = compare[0];
+  s.value = (float)atof(l.words[3].c_str());
+  return true;
+}
+
+void recipe::set(float value, float seconds) {
+  steps.push_back(recipestep{recipestep::SET, value, seconds, 0, 0, 0});
+}
+
+bool recipe::listable() const {
+  for (const recipestep& s : steps) {
+    if (s.code != recipestep::SET) {
+      return false;
+    }
+  }
+  return !steps.empty();
+}
+
+recipe recipe::builtin(int mode, int load_type, int sweep_type,
+                       float set_current, float set_voltage, float ocv,
+                       int step, float step_time, int repeat) {
+  std::vector<float> inputs;
+  if (sweep_type == 0) {
+    repeat = 1;
+    for (int i = 0; i < step + 1; i++) {
+      if (mode == 0) {
+        // in current load switch, ocv is i_start
+        inputs.push_back((set_current - ocv) / step * i + ocv);
+      } else {
+        inputs.push_back((set_voltage - ocv) / step * i + ocv);
+      }
+    }
+  } else {
+    std::vector<float> items;
+    if (sweep_type == 1) {
+      for (int i = 0; i < step + 1; i++) {
+        if (mode == 0 && load_type == 0) {
+          // in current load switch, ocv is i_start
+          items.push_back((set_current - ocv) / step * i + ocv);
+        } else {
+          items.push_back((set_voltage - ocv) / step * i + ocv);
+        }
+      }
+    }
+    if (sweep_type == 2) {
+      for (int i = 0; i < step + 1; i++) {
+        items.push_back((ocv - set_voltage) * 2. / step * i + set_voltage);
+      }
+    }
+    for (int i = 0; i < (int)items.size(); i++) {
+      for (int j = i + 1; j < (int)items.size(); j++) {
+        inputs.push_back(items[i]);
+        inputs.push_back(items[j]);
+        inputs.push_back(items[i]);
+      }
+    }
+  }
+
+  recipe r;
+  for (int n = 0; n < repeat; n++) {
+    // Later passes start where the previous one ended.
+    for (int i = n > 0 ? 1 : 0; i < (int)inputs.size(); i++) {
+      // The mode switch sweep hands over between the load (at or below open
+      // circuit) and the supply every time it crosses open circuit.
+      if (sweep_type == 2 &&
+          (i == 0 || (inputs[i - 1] - ocv) * (inputs[i] - ocv) <= 0)) {
+        r.steps.push_back(recipestep{
+            recipestep::MODE, inputs[i] <= ocv ? 0.0f : 1.0f, 0.0f, 0, 0, 0});
+      }
+      r.set(inputs[i], step_time);
+    }
+  }
+  return r;
+}
@@ -0,0 +1,59 @@
+﻿#pragma once
+#include <istream>
+#include <string>
+#include <vector>
+
+// One instruction of a compiled test program.
+struct recipestep {
+  enum op { MODE, LOAD, SET, HOLD, JUMP_IF };
+  op code;
+  float value;    // MODE 0 fc / 1 ec, LOAD 0 cc / 1 cv, SET setpoint,
+                  // JUMP_IF threshold
+  float seconds;  // SET/HOLD dwell before the step is recorded
+  char variable;  // JUMP_IF: 'V', 'I' or 'P' of the last reading
+  char compare;   // JUMP_IF: '<' or '>'
+  int target;     // JUMP_IF: step to continue at
+};
+
+// A test profile compiled once into a flat step program: loops are
+// unrolled and conditions become jumps, so the sweep engine only ever steps
+// through a list. Recipe files are line based and '#' starts a comment:
+//
+//   mode fc|ec               fuel cell (load) or electrolysis (supply)
+//   load cc|cv               load setpoint type in fuel-cell mode
+//   set X T                  go to setpoint X, dwell T s, record
+//   ramp A B N T             N+1 evenly spaced setpoints from A to B
+//   switch A B N T           every pair of N+1 levels from A to B as a-b-a
+//   hold T                   stay at the setpoint T s, record
+//   repeat N ... end         the enclosed lines N times
+//   break_if V|I|P <|> X     leave the innermost repeat once the last
+//                            reading meets the condition
+//   stop_if V|I|P <|> X      end the recipe likewise
+class recipe {
+ public:
+  recipe() {}
+  // A program compiled earlier, e.g. restored from a checkpoint.
+  explicit recipe(const std::vector<recipestep>& steps) : steps(steps) {}
+  bool load(const char* path);
+  bool compile(std::istream& in);
+  const std::vector<recipestep>& program() const { return steps; }
+  // True if the program only sets and holds, so an instrument can run it
+  // from a step list.
+  bool listable() const;
+
+  // The sweep types of the UI as built-in recipes.
+  static recipe builtin(int mode, int load_type, int sweep_type,
+                        float set_current, float set_voltage, float ocv,
+                        int step, float step_time, int repeat);
+
+ private:
+  struct line {
+    int number;
+    std::vector<std::string> words;
+  };
+  bool emit(const std::vector<line>& lines, size_t& pos, int depth,
+            std::vector<size_t>* breaks);
+  bool condition(const line& l, recipestep& s);
+  void set(float value, float seconds);
+  std::vector<recipestep> steps;
+};
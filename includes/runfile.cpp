@@ -0,0 +1,380 @@
+﻿#include "runfile.hpp"
+
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+
+namespace {
+const char run_magic[4] = {'R', 'F', 'C', 'R'};
+const uint32_t run_version = 2;
+// Bytes per row in a version 1 block: one double and four floats.
+const long long row_bytes = sizeof(double) + 4 * sizeof(float);
+// Version 2 block timestamps are whole microseconds.
+const double ticks_per_second = 1e6;
+
+// Run files of a month-long log are past what a long offset holds on
+// Windows.
+int seek(FILE* fp, long long offset, int origin) {
+#ifdef _WIN32
+  return _fseeki64(fp, offset, origin);
+#else
+  return fseeko(fp, offset, origin);
+#endif
+}
+
+long long tell(FILE* fp) {
+#ifdef _WIN32
+  return _ftelli64(fp);
+#else
+  return ftello(fp);
+#endif
+}
+
+// Reads `count` rows of block data at the current position onto `out`.
+bool readColumns(FILE* fp, uint32_t count, runcolumns& out) {
+  const size_t base = out.time.size();
+  out.time.resize(base + count);
+  out.voltage.resize(base + count);
+  out.current.resize(base + count);
+  out.power.resize(base + count);
+  out.hydrogen.resize(base + count);
+  return fread(out.time.data() + base, sizeof(double), count, fp) == count &&
+         fread(out.voltage.data() + base, sizeof(float), count, fp) == count &&
+         fread(out.current.data() + base, sizeof(float), count, fp) == count &&
+         fread(out.power.data() + base, sizeof(float), count, fp) == count &&
+         fread(out.hydrogen.data() + base, sizeof(float), count, fp) == count;
+}
+
+// Reads and decodes `count` rows of version 2 block data at the current
+// position onto `out`.
+bool decodeColumns(FILE* fp, uint32_t count, runcolumns& out) {
+  uint32_t sizes[5];
+  if (fread(sizes, sizeof(uint32_t), 5, fp) != 5) {
+    return false;
+  }
+  size_t total = 0;
+  for (uint32_t size : sizes) {
+    total += size;
+  }
+  std::vector<uint8_t> payload(total);
+  if (fread(payload.data(), 1, total, fp) != total) {
+    return false;
+  }
+  const size_t base = out.time.size();
+  out.time.resize(base + count);
+  out.voltage.resize(base + count);
+  out.current.resize(base + count);
+  out.power.resize(base + count);
+  out.hydrogen.resize(base + count);
+  std::vector<int64_t> ticks(count);
+  const uint8_t* p = payload.data();
+  if (!gorillatimes::decode(p, sizes[0], count, ticks.data())) {
+    return false;
+  }
+  for (uint32_t k = 0; k < count; k++) {
+    out.time[base + k] = ticks[k] / ticks_per_second;
+  }
+  p += sizes[0];
+  float* columns[4] = {out.voltage.data() + base, out.current.data() + base,
+                       out.power.data() + base, out.hydrogen.data() + base};
+  for (int c = 0; c < 4; c++) {
+    if (!gorillafloats::decode(p, sizes[c + 1], count, columns[c])) {
+      return false;
+    }
+    p += sizes[c + 1];
+  }
+  return true;
+}
+}  // namespace
+
+const char* csv_header =
+    "time,voltage,current,power,hydrogen,mode,temperature,fuel_flow,air_flow,"
+    "load_type\n";
+
+int csvLine(const logrecord& r, char* line, size_t size) {
+  return snprintf(line, size,
+                  "%.4f,%.2f,%.3f,%.3f,%.3f,%d,%.1f,%.3f,%.3f,%d\n", r.time,
+                  r.voltage, r.current, r.power, r.hydrogen, r.mode,
+                  r.temperature, r.fuel_flow, r.air_flow, r.load_type);
+}
+
+runwriter::~runwriter() { close(); }
+
+bool runwriter::open(const std::string& path, const runheader& header) {
+  std::error_code error;
+  if (std::filesystem::file_size(path, error) > 0 && !error) {
+    long long end = 0;
+    {
+      runreader existing;
+      if (!existing.open(path)) {
+        return false;
+      }
+      end = existing.end();
+      version = existing.header().version;
+    }
+    // A block torn by a crash is dropped before the run continues.
+    std::filesystem::resize_file(path, end, error);
+    store.reset(logstore::open(path, false));
+    return store != nullptr;
+  }
+  store.reset(logstore::open(path, true));
+  if (!store) {
+    return false;
+  }
+  runheader head = header;
+  memcpy(head.magic, run_magic, sizeof(run_magic));
+  head.version = version = run_version;
+  store->write(&head, sizeof(head));
+  store->flush();
+  return true;
+}
+
+uint32_t runwriter::add(const logrecord& r) {
+  uint32_t out = 0;
+  if (block.count > 0 &&
+      (r.mode != block.mode || r.load_type != block.load_type ||
+       r.temperature != block.temperature || r.fuel_flow != block.fuel_flow ||
+       r.air_flow != block.air_flow ||
+       r.time - block.time_min >= block_seconds)) {
+    out += write();
+  }
+  const float values[4] = {r.voltage, r.current, r.power, r.hydrogen};
+  if (block.count == 0) {
+    block.mode = r.mode;
+    block.load_type = r.load_type;
+    block.temperature = r.temperature;
+    block.fuel_flow = r.fuel_flow;
+    block.air_flow = r.air_flow;
+    block.time_min = block.time_max = r.time;
+    std::copy(values, values + 4, block.min);
+    std::copy(values, values + 4, block.max);
+  }
+  block.time_min = (std::min)(block.time_min, r.time);
+  block.time_max = (std::max)(block.time_max, r.time);
+  for (int k = 0; k < 4; k++) {
+    block.min[k] = (std::min)(block.min[k], values[k]);
+    block.max[k] = (std::max)(block.max[k], values[k]);
+  }
+  if (version == 1) {
+    rows.time.push_back(r.time);
+    rows.voltage.push_back(r.voltage);
+    rows.current.push_back(r.current);
+    rows.power.push_back(r.power);
+    rows.hydrogen.push_back(r.hydrogen);
+  } else {
+    times.add(std::llround(r.time * ticks_per_second));
+    for (int k = 0; k < 4; k++) {
+      columns[k].add(values[k]);
+    }
+  }
+  if (++block.count == block_rows) {
+    out += write();
+  }
+  return out;
+}
+
+uint32_t runwriter::flush() { return write(); }
+
+uint32_t runwriter::close() {
+  const uint32_t out = write();
+  store.reset();
+  return out;
+}
+
+uint32_t runwriter::write() {
+  const uint32_t count = block.count;
+  if (count == 0 || !store) {
+    return 0;
+  }
+  const long long offset = store->size();
+  store->write(&block, sizeof(block));
+  if (version == 1) {
+    store->write(rows.time.data(), sizeof(double) * count);
+    store->write(rows.voltage.data(), sizeof(float) * count);
+    store->write(rows.current.data(), sizeof(float) * count);
+    store->write(rows.power.data(), sizeof(float) * count);
+    store->write(rows.hydrogen.data(), sizeof(float) * count);
+  } else {
+    const std::vector<uint8_t>* streams[5] = {
+        &times.bytes(), &columns[0].bytes(), &columns[1].bytes(),
+        &columns[2].bytes(), &columns[3].bytes()};
+    uint32_t sizes[5];
+    for (int k = 0; k < 5; k++) {
+      sizes[k] = (uint32_t)streams[k]->size();
+    }
+    store->write(sizes, sizeof(sizes));
+    for (int k = 0; k < 5; k++) {
+      store->write(streams[k]->data(), sizes[k]);
+    }
+  }
+  // The index entry must not point past what a reader can see yet.
+  if (store->sync() && written) {
+    written(block, offset);
+  }
+  block = runblock();
+  rows.time.clear();
+  rows.voltage.clear();
+  rows.current.clear();
+  rows.power.clear();
+  rows.hydrogen.clear();
+  times.clear();
+  for (gorillafloats& c : columns) {
+    c.clear();
+  }
+  return count;
+}
+
+runreader::~runreader() {
+  if (fp) {
+    fclose(fp);
+  }
+}
+
+bool runreader::open(const std::string& path, bool scan) {
+  fp = fopen(path.c_str(), "rb");
+  if (!fp) {
+    return false;
+  }
+  if (fread(&head, sizeof(head), 1, fp) != 1 ||
+      memcmp(head.magic, run_magic, sizeof(run_magic)) != 0 ||
+      head.version < 1 || head.version > run_version) {
+    std::cout << path << " 不是运行数据文件!" << std::endl;
+    return false;
+  }
+  if (!scan) {
+    return true;
+  }
+  seek(fp, 0, SEEK_END);
+  const long long size = tell(fp);
+  long long offset = sizeof(head);
+  runblock block;
+  while (seek(fp, offset, SEEK_SET) == 0 &&
+         fread(&block, sizeof(block), 1, fp) == 1 &&
+         block.count <= runwriter::block_rows) {
+    long long next = offset + (long long)sizeof(block);
+    if (head.version == 1) {
+      next += row_bytes * (long long)block.count;
+    } else {
+      uint32_t sizes[5];
+      if (fread(sizes, sizeof(uint32_t), 5, fp) != 5) {
+        break;
+      }
+      next += (long long)sizeof(sizes);
+      for (uint32_t s : sizes) {
+        next += s;
+      }
+    }
+    if (next > size) {
+      break;
+    }
+    index.push_back(block);
+    offsets.push_back(offset);
+    offset = next;
+  }
+  valid_end = offset;
+  return true;
+}
+
+bool runreader::read(size_t i, runcolumns& out) {
+  return i < index.size() && readAt(offsets[i], out);
+}
+
+bool runreader::readAt(long long offset, runcolumns& out, runblock* block) {
+  runblock b;
+  if (seek(fp, offset, SEEK_SET) != 0 || fread(&b, sizeof(b), 1, fp) != 1 ||
+      b.count > runwriter::block_rows) {
+    return false;
+  }
+  if (block) {
+    *block = b;
+  }
+  return head.version == 1 ? readColumns(fp, b.count, out)
+                           : decodeColumns(fp, b.count, out);
+}
+
+bool runreader::read(double begin, double end, runcolumns& out) {
+  runcolumns block;
+  for (size_t i = 0; i < index.size(); i++) {
+    if (index[i].time_max < begin || index[i].time_min > end) {
+      continue;
+    }
+    if (index[i].time_min >= begin && index[i].time_max <= end) {
+      if (!read(i, out)) {
+        return false;
+      }
+      continue;
+    }
+    block = runcolumns();
+    if (!read(i, block)) {
+      return false;
+    }
+    for (size_t k = 0; k < block.time.size(); k++) {
+      if (block.time[k] >= begin && block.time[k] <= end) {
+        out.time.push_back(block.time[k]);
+        out.voltage.push_back(block.voltage[k]);
+        out.current.push_back(block.current[k]);
+        out.power.push_back(block.power[k]);
+        out.hydrogen.push_back(block.hydrogen[k]);
+      }
+    }
+  }
+  return true;
+}
+
+void writeCsv(FILE* fp, const runblock& b, const runcolumns& rows,
+              double begin, double end) {
+  std::string text;
+  char line[160];
+  logrecord r = {};
+  r.mode = b.mode;
+  r.temperature = b.temperature;
+  r.fuel_flow = b.fuel_flow;
+  r.air_flow = b.air_flow;
+  r.load_type = b.load_type;
+  for (size_t k = 0; k < rows.time.size(); k++) {
+    if (rows.time[k] < begin || rows.time[k] > end) {
+      continue;
+    }
+    r.time = rows.time[k];
+    r.voltage = rows.voltage[k];
+    r.current = rows.current[k];
+    r.power = rows.power[k];
+    r.hydrogen = rows.hydrogen[k];
+    text.append(line, csvLine(r, line, sizeof(line)));
+  }
+  fwrite(text.data(), 1, text.size(), fp);
+}
+
+bool exportCsv(const std::string& run_path, const std::string& csv_path,
+               double begin, double end) {
+  runreader reader;
+  if (!reader.open(run_path)) {
+    return false;
+  }
+  FILE* fp = fopen(csv_path.c_str(), "w");
+  if (!fp) {
+    std::cout << "无法创建 " << csv_path << "!" << std::endl;
+    return false;
+  }
+  fputs(csv_header, fp);
+  runcolumns rows;
+  for (size_t i = 0; i < reader.blocks().size(); i++) {
+    const runblock& b = reader.blocks()[i];
+    if (b.time_max < begin || b.time_min > end) {
+      continue;
+    }
+    rows = runcolumns();
+    if (!reader.read(i, rows)) {
+      std::cout << "读取 " << run_path << " 第 " << i
+                << " 块失败, CSV 截止于 t=" << b.time_min << "!" << std::endl;
+      fclose(fp);
+      return false;
+    }
+    writeCsv(fp, b, rows, begin, end);
+  }
+  fclose(fp);
+  return true;
+}
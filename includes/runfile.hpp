@@ -0,0 +1,147 @@
+﻿#pragma once
+#include <stdint.h>
+#include <stdio.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gorilla.hpp"
+#include "logstore.hpp"
+
+// One CSV line: a sample and the conditions it was taken under.
+struct logrecord {
+  double time;
+  float voltage;
+  float current;
+  float power;
+  float hydrogen;
+  int mode;
+  float temperature;
+  float fuel_flow;
+  float air_flow;
+  int load_type;
+};
+
+// The sample log's CSV columns.
+extern const char* csv_header;
+// Formats `r` as a CSV line into `line`; returns its length.
+int csvLine(const logrecord& r, char* line, size_t size);
+
+// Binary run file: a runheader, then blocks of up to `block_rows` samples.
+// Each block starts with a runblock holding the settings its rows were taken
+// under and the range of every column, followed by the columns one after the
+// other: time, then voltage, current, power and hydrogen. A reader can skip
+// a block from its header alone. Little-endian, as written.
+//
+// Version 1 stores the columns raw, as double and floats. Version 2 stores
+// the byte size of each column after the runblock, then the columns Gorilla
+// compressed: time as whole microseconds, the values bit-exact.
+struct runheader {
+  char magic[4];
+  uint32_t version;
+  int32_t mode;
+  int32_t load_type;
+  int32_t sweep_type;
+  float temperature;
+  float fuel_flow;
+  float air_flow;
+  int64_t started;  // seconds since the epoch
+};
+
+struct runblock {
+  uint32_t count;
+  int32_t mode;
+  int32_t load_type;
+  float temperature;
+  float fuel_flow;
+  float air_flow;
+  double time_min;
+  double time_max;
+  float min[4];  // voltage, current, power, hydrogen
+  float max[4];
+};
+
+static_assert(sizeof(runheader) == 40, "runheader is an on-disk layout");
+static_assert(sizeof(runblock) == 72, "runblock is an on-disk layout");
+
+struct runcolumns {
+  std::vector<double> time;
+  std::vector<float> voltage;
+  std::vector<float> current;
+  std::vector<float> power;
+  std::vector<float> hydrogen;
+};
+
+// Collects samples into blocks and appends each block when it is full, when
+// the settings change, when it spans `block_seconds` or when flush() is
+// called; at most that much is lost if the program dies.
+class runwriter {
+ public:
+  static const uint32_t block_rows = 4096;
+  static constexpr double block_seconds = 60.0;
+
+  ~runwriter();
+  // Creates the file with `header`, or continues an existing run file after
+  // its last complete block.
+  bool open(const std::string& path, const runheader& header);
+  // Returns the number of rows written to disk by this call.
+  uint32_t add(const logrecord& r);
+  // Ends the open block and writes it, however few rows it holds.
+  uint32_t flush();
+  uint32_t close();
+  // Bytes in the file so far.
+  long long size() const { return store ? store->size() : 0; }
+
+  // Called after each block is on disk, with the offset it starts at.
+  std::function<void(const runblock& block, long long offset)> written;
+
+ private:
+  uint32_t write();
+  std::unique_ptr<logstore> store;
+  uint32_t version = 0;
+  runblock block = {};
+  // The open block, raw for version 1 and encoded as it grows otherwise.
+  runcolumns rows;
+  gorillatimes times;
+  gorillafloats columns[4];
+};
+
+class runreader {
+ public:
+  ~runreader();
+  // Reads the header and, if `scan`, the block headers; the columns are
+  // read on demand.
+  bool open(const std::string& path, bool scan = true);
+  const runheader& header() const { return head; }
+  const std::vector<runblock>& blocks() const { return index; }
+  long long offset(size_t i) const { return offsets[i]; }
+  // Appends the rows of block `i`.
+  bool read(size_t i, runcolumns& out);
+  // Appends the rows of the block at byte `offset`, as an index gives it,
+  // without scanning the file.
+  bool readAt(long long offset, runcolumns& out, runblock* block = nullptr);
+  // Appends the rows with `begin` <= time <= `end`, reading only the blocks
+  // whose time range overlaps.
+  bool read(double begin, double end, runcolumns& out);
+  // Where the complete blocks end; anything after is a torn write.
+  long long end() const { return valid_end; }
+
+ private:
+  FILE* fp = NULL;
+  runheader head = {};
+  std::vector<runblock> index;
+  std::vector<long long> offsets;
+  long long valid_end = 0;
+};
+
+// Appends the rows of block `b` with `begin` <= time <= `end` to a CSV file.
+void writeCsv(FILE* fp, const runblock& b, const runcolumns& rows,
+              double begin, double end);
+
+// Writes the rows of a run file with `begin` <= time <= `end` as the same CSV
+// the sample log writes. Returns false if a block cannot be read; the CSV
+// then ends before that block.
+bool exportCsv(const std::string& run_path, const std::string& csv_path,
+               double begin = -1e300, double end = 1e300);
@@ -0,0 +1,226 @@
+﻿#include "runlog.hpp"
+
+#include <filesystem>
+#include <iostream>
+
+namespace {
+const char* index_header = "# segment offset count time_min time_max\n";
+
+void writeEntry(FILE* fp, int segment, long long offset, const runblock& b) {
+  fprintf(fp, "%d %lld %u %.6f %.6f\n", segment, offset, b.count, b.time_min,
+          b.time_max);
+}
+}  // namespace
+
+runlog::~runlog() { close(); }
+
+std::string runlog::segmentPath(const std::string& base, int segment) {
+  char suffix[32];
+  sprintf(suffix, ".%03d.run", segment);
+  return base + suffix;
+}
+
+std::string runlog::indexPath(const std::string& base) {
+  return base + ".idx";
+}
+
+bool runlog::reindex(const std::string& base) {
+  FILE* fp = fopen(indexPath(base).c_str(), "w");
+  if (!fp) {
+    return false;
+  }
+  fputs(index_header, fp);
+  std::error_code error;
+  for (int n = 0; std::filesystem::exists(segmentPath(base, n), error); n++) {
+    runreader reader;
+    if (!reader.open(segmentPath(base, n))) {
+      break;
+    }
+    for (size_t i = 0; i < reader.blocks().size(); i++) {
+      writeEntry(fp, n, reader.offset(i), reader.blocks()[i]);
+    }
+  }
+  fclose(fp);
+  return true;
+}
+
+bool runlog::loadIndex(const std::string& base,
+                       std::vector<runindexentry>& index) {
+  FILE* fp = fopen(indexPath(base).c_str(), "r");
+  if (!fp) {
+    if (!reindex(base) || !(fp = fopen(indexPath(base).c_str(), "r"))) {
+      return false;
+    }
+  }
+  char line[160];
+  while (fgets(line, sizeof(line), fp)) {
+    runindexentry e;
+    if (line[0] != '#' &&
+        sscanf(line, "%d %lld %u %lf %lf", &e.segment, &e.offset, &e.count,
+               &e.time_min, &e.time_max) == 5) {
+      index.push_back(e);
+    }
+  }
+  fclose(fp);
+  return true;
+}
+
+bool runlog::open(const std::string& base, const runheader& header) {
+  this->base = base;
+  this->header = header;
+  std::error_code error;
+  int last = -1;
+  while (std::filesystem::exists(segmentPath(base, last + 1), error)) {
+    last++;
+  }
+  if (last >= 0) {
+    // The index may be missing blocks written just before a crash.
+    reindex(base);
+  }
+  index = fopen(indexPath(base).c_str(), "a");
+  if (!index) {
+    std::cout << "无法创建 " << indexPath(base) << "!" << std::endl;
+    return false;
+  }
+  if (last < 0) {
+    fputs(index_header, index);
+    fflush(index);
+  }
+  return openSegment(last < 0 ? 0 : last);
+}
+
+bool runlog::openSegment(int n) {
+  segment = n;
+  writer.reset(new runwriter());
+  started = false;
+  {
+    runreader existing;
+    if (existing.open(segmentPath(base, n)) && !existing.blocks().empty()) {
+      started = true;
+      segment_start = existing.blocks().front().time_min;
+    }
+  }
+  writer->written = [this](const runblock& b, long long offset) {
+    writeEntry(index, segment, offset, b);
+    fflush(index);
+  };
+  return writer->open(segmentPath(base, n), header);
+}
+
+uint32_t runlog::add(const logrecord& r) {
+  if (!writer) {
+    return 0;
+  }
+  uint32_t out = 0;
+  if (started && (writer->size() >= segment_bytes ||
+                  r.time - segment_start >= segment_seconds)) {
+    out += writer->close();
+    if (!openSegment(segment + 1)) {
+      std::cout << "无法创建 " << segmentPath(base, segment) << "!"
+                << std::endl;
+      writer.reset();
+      return out;
+    }
+  }
+  if (!started) {
+    started = true;
+    segment_start = r.time;
+  }
+  return out + writer->add(r);
+}
+
+uint32_t runlog::flush() { return writer ? writer->flush() : 0; }
+
+uint32_t runlog::close() {
+  uint32_t out = 0;
+  if (writer) {
+    out = writer->close();
+    writer.reset();
+  }
+  if (index) {
+    fclose(index);
+    index = NULL;
+  }
+  return out;
+}
+
+bool runlog::read(const std::string& base, double begin, double end,
+                  runcolumns& out) {
+  std::vector<runindexentry> index;
+  if (!loadIndex(base, index)) {
+    return false;
+  }
+  std::unique_ptr<runreader> reader;
+  int opened = -1;
+  runcolumns block;
+  for (const runindexentry& e : index) {
+    if (e.time_max < begin || e.time_min > end) {
+      continue;
+    }
+    if (e.segment != opened) {
+      reader.reset(new runreader());
+      if (!reader->open(segmentPath(base, e.segment), false)) {
+        return false;
+      }
+      opened = e.segment;
+    }
+    block = runcolumns();
+    if (!reader->readAt(e.offset, block)) {
+      return false;
+    }
+    for (size_t k = 0; k < block.time.size(); k++) {
+      if (block.time[k] >= begin && block.time[k] <= end) {
+        out.time.push_back(block.time[k]);
+        out.voltage.push_back(block.voltage[k]);
+        out.current.push_back(block.current[k]);
+        out.power.push_back(block.power[k]);
+        out.hydrogen.push_back(block.hydrogen[k]);
+      }
+    }
+  }
+  return true;
+}
+
+bool runlog::exportCsv(const std::string& base, const std::string& csv_path,
+                       double begin, double end) {
+  std::vector<runindexentry> index;
+  if (!loadIndex(base, index)) {
+    return false;
+  }
+  FILE* fp = fopen(csv_path.c_str(), "w");
+  if (!fp) {
+    std::cout << "无法创建 " << csv_path << "!" << std::endl;
+    return false;
+  }
+  fputs(csv_header, fp);
+  std::unique_ptr<runreader> reader;
+  int opened = -1;
+  runcolumns rows;
+  runblock b;
+  for (const runindexentry& e : index) {
+    if (e.time_max < begin || e.time_min > end) {
+      continue;
+    }
+    if (e.segment != opened) {
+      reader.reset(new runreader());
+      if (!reader->open(segmentPath(base, e.segment), false)) {
+        std::cout << "无法打开 " << segmentPath(base, e.segment)
+                  << ", CSV 截止于 t=" << e.time_min << "!" << std::endl;
+        fclose(fp);
+        return false;
+      }
+      opened = e.segment;
+    }
+    rows = runcolumns();
+    if (!reader->readAt(e.offset, rows, &b)) {
+      std::cout << "读取 " << segmentPath(base, e.segment) << " 偏移 "
+                << e.offset << " 失败, CSV 截止于 t=" << e.time_min << "!"
+                << std::endl;
+      fclose(fp);
+      return false;
+    }
+    writeCsv(fp, b, rows, begin, end);
+  }
+  fclose(fp);
+  return true;
+}
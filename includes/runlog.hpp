@@ -0,0 +1,66 @@
+﻿#pragma once
+#include <stdio.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "runfile.hpp"
+
+// Where one block of a segmented run is.
+struct runindexentry {
+  int segment;
+  long long offset;
+  uint32_t count;
+  double time_min;
+  double time_max;
+};
+
+// A run split into segments "<base>.000.run", "<base>.001.run", ..., each a
+// complete run file, with a text index "<base>.idx" of one line per block:
+// segment, byte offset, rows, first and last time. A reader goes from the
+// index straight to the blocks of any time range, and a finished segment can
+// be compressed or archived on its own.
+class runlog {
+ public:
+  // A segment is closed once it holds either this many bytes or this many
+  // seconds of samples.
+  static const long long segment_bytes = 64ll << 20;
+  static constexpr double segment_seconds = 3600.0;
+
+  ~runlog();
+  // Starts a run at `base`, or continues the last segment of an existing
+  // one after bringing its index up to date.
+  bool open(const std::string& base, const runheader& header);
+  // Returns the number of rows written to disk by this call.
+  uint32_t add(const logrecord& r);
+  // Writes the open block of the current segment; see runwriter::flush.
+  uint32_t flush();
+  uint32_t close();
+
+  static std::string segmentPath(const std::string& base, int segment);
+  static std::string indexPath(const std::string& base);
+  // Rewrites the index from the segments on disk.
+  static bool reindex(const std::string& base);
+  // Reads the index, rebuilding it first if it is missing.
+  static bool loadIndex(const std::string& base,
+                        std::vector<runindexentry>& index);
+  // Appends the rows with `begin` <= time <= `end`, opening only the
+  // segments and blocks the index points to.
+  static bool read(const std::string& base, double begin, double end,
+                   runcolumns& out);
+  // Writes the rows with `begin` <= time <= `end` as CSV. Returns false if a
+  // segment or block cannot be read; the CSV then ends before it.
+  static bool exportCsv(const std::string& base, const std::string& csv_path,
+                        double begin = -1e300, double end = 1e300);
+
+ private:
+  bool openSegment(int n);
+  std::string base;
+  runheader header = {};
+  int segment = -1;
+  bool started = false;  // the segment has a first sample time
+  double segment_start = 0.0;
+  std::unique_ptr<runwriter> writer;
+  FILE* index = NULL;
+};
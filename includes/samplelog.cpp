@@ -0,0 +1,211 @@
+﻿#include "samplelog.hpp"
+
+#include <iostream>
+
+namespace {
+// A buffer this large goes out before the flush interval is up.
+const size_t buffer_limit = 1 << 16;
+// How often the writer empties the ring.
+const std::chrono::milliseconds drain_period(10);
+}  // namespace
+
+samplelog::samplelog(double flush_interval) : interval(flush_interval) {
+  worker = std::thread(&samplelog::run, this);
+}
+
+samplelog::~samplelog() {
+  running = false;
+  if (worker.joinable()) {
+    worker.join();
+  }
+}
+
+int samplelog::open(const std::string& path, const char* header) {
+  return openTarget(target{path, header, CSV, runheader()});
+}
+
+int samplelog::openRun(const std::string& path, const runheader& header) {
+  return openTarget(target{path, "", RUN, header});
+}
+
+int samplelog::openSegments(const std::string& base,
+                            const runheader& header) {
+  return openTarget(target{base, "", SEGMENTS, header});
+}
+
+int samplelog::openTarget(const target& t) {
+  const int file = next_file++;
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    pending[file] = t;
+  }
+  push(entry{OPEN, file, logrecord()});
+  return file;
+}
+
+void samplelog::close(int file) { push(entry{CLOSE, file, logrecord()}); }
+
+void samplelog::write(int file, const logrecord& r) {
+  push(entry{RECORD, file, r});
+}
+
+void samplelog::setFlushInterval(double seconds) { interval = seconds; }
+
+samplelog::counters samplelog::stats() const {
+  counters c;
+  c.depth = ring.size();
+  c.max_depth = max_depth;
+  c.write_ms = write_ms;
+  c.max_write_ms = max_write_ms;
+  c.written = written;
+  return c;
+}
+
+void samplelog::push(const entry& e) {
+  // The ring only fills if the disk has stalled for longer than it holds;
+  // waiting then is better than losing lines.
+  while (!ring.push(e)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+void samplelog::flush(logfile& f) {
+  if (f.run || f.segments) {
+    const std::chrono::steady_clock::time_point begin =
+        std::chrono::steady_clock::now();
+    const uint32_t rows = f.run ? f.run->flush() : f.segments->flush();
+    if (rows > 0) {
+      wrote(begin, rows);
+    }
+    return;
+  }
+  if (f.buffer.empty() || !f.out) {
+    f.buffer.clear();
+    f.lines = 0;
+    return;
+  }
+  const std::chrono::steady_clock::time_point begin =
+      std::chrono::steady_clock::now();
+  f.out->write(f.buffer.data(), f.buffer.size());
+  f.out->flush();
+  wrote(begin, f.lines);
+  f.buffer.clear();
+  f.lines = 0;
+}
+
+void samplelog::wrote(std::chrono::steady_clock::time_point begin,
+                      unsigned long long lines) {
+  const double ms = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - begin)
+                        .count();
+  write_ms = ms;
+  if (ms > max_write_ms) {
+    max_write_ms = ms;
+  }
+  written += lines;
+}
+
+void samplelog::shut(logfile& f) {
+  if (f.run || f.segments) {
+    const std::chrono::steady_clock::time_point begin =
+        std::chrono::steady_clock::now();
+    wrote(begin, f.run ? f.run->close() : f.segments->close());
+    f.run.reset();
+    f.segments.reset();
+    return;
+  }
+  flush(f);
+  f.out.reset();
+}
+
+void samplelog::run() {
+  using clock = std::chrono::steady_clock;
+  clock::time_point last_flush = clock::now();
+  char line[160];
+  entry e;
+  while (true) {
+    // Read before draining so nothing pushed ahead of the stop is missed.
+    const bool stopping = !running;
+    const size_t depth = ring.size();
+    if (depth > max_depth) {
+      max_depth = depth;
+    }
+    while (ring.pop(e)) {
+      if (e.what == OPEN) {
+        target t;
+        {
+          std::lock_guard<std::mutex> lock(mtx);
+          t = pending[e.file];
+          pending.erase(e.file);
+        }
+        logfile& f = files[e.file];
+        if (t.as == RUN) {
+          f.run.reset(new runwriter());
+          if (!f.run->open(t.path, t.meta)) {
+            std::cout << "打开日志文件 " << t.path << " 失败!" << std::endl;
+            f.run.reset();
+          }
+          continue;
+        }
+        if (t.as == SEGMENTS) {
+          f.segments.reset(new runlog());
+          if (!f.segments->open(t.path, t.meta)) {
+            std::cout << "打开日志文件 " << t.path << " 失败!" << std::endl;
+            f.segments.reset();
+          }
+          continue;
+        }
+        f.out.reset(logstore::open(t.path, false));
+        if (!f.out) {
+          std::cout << "打开日志文件 " << t.path << " 失败!" << std::endl;
+          continue;
+        }
+        if (f.out->size() == 0) {
+          f.buffer = t.header;
+        }
+      } else if (e.what == CLOSE) {
+        std::map<int, logfile>::iterator f = files.find(e.file);
+        if (f != files.end()) {
+          shut(f->second);
+          files.erase(f);
+        }
+      } else {
+        std::map<int, logfile>::iterator f = files.find(e.file);
+        if (f == files.end()) {
+          continue;
+        }
+        if (f->second.run || f->second.segments) {
+          const std::chrono::steady_clock::time_point begin =
+              std::chrono::steady_clock::now();
+          const uint32_t rows = f->second.run ? f->second.run->add(e.r)
+                                              : f->second.segments->add(e.r);
+          if (rows > 0) {
+            wrote(begin, rows);
+          }
+          continue;
+        }
+        f->second.buffer.append(line, csvLine(e.r, line, sizeof(line)));
+        f->second.lines++;
+        if (f->second.buffer.size() >= buffer_limit) {
+          flush(f->second);
+        }
+      }
+    }
+    const clock::time_point now = clock::now();
+    if (stopping ||
+        std::chrono::duration<double>(now - last_flush).count() >= interval) {
+      for (std::pair<const int, logfile>& f : files) {
+        flush(f.second);
+      }
+      last_flush = now;
+    }
+    if (stopping) {
+      break;
+    }
+    std::this_thread::sleep_for(drain_period);
+  }
+  for (std::pair<const int, logfile>& f : files) {
+    shut(f.second);
+  }
+  files.clear();
+}
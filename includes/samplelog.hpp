@@ -0,0 +1,92 @@
+﻿#pragma once
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "runfile.hpp"
+#include "runlog.hpp"
+#include "spscring.hpp"
+
+// Writes sample logs on its own thread. The caller only pushes records into
+// a ring; the writer keeps its files open, formats CSV records into one
+// buffer per file and writes a buffer out in a single call when it fills or
+// when the flush interval has passed. Run files are written a block at a
+// time, once it holds runwriter::block_rows rows or spans block_seconds, and
+// at least every flush interval; a short interval costs some compression.
+// All files go through logstore, so the writes can use io_uring. open(),
+// close() and write() must all be called from the same thread.
+class samplelog {
+ public:
+  struct counters {
+    size_t depth;         // records waiting for the writer
+    size_t max_depth;
+    double write_ms;      // last buffer write, including the flush
+    double max_write_ms;
+    unsigned long long written;
+  };
+
+  explicit samplelog(double flush_interval = 1.0);
+  // Writes out everything still queued before closing the files.
+  ~samplelog();
+  // Appends to `path`, starting with `header` if the file is new; returns
+  // the handle for write() and close().
+  int open(const std::string& path, const char* header);
+  // Appends to the binary run file `path`; see runwriter.
+  int openRun(const std::string& path, const runheader& header);
+  // Appends to the segmented run at `base`; see runlog.
+  int openSegments(const std::string& base, const runheader& header);
+  void close(int file);
+  void write(int file, const logrecord& r);
+  void setFlushInterval(double seconds);
+  counters stats() const;
+
+ private:
+  enum kind { OPEN, RECORD, CLOSE };
+  struct entry {
+    kind what;
+    int file;
+    logrecord r;
+  };
+  enum format { CSV, RUN, SEGMENTS };
+  struct target {
+    std::string path;
+    std::string header;
+    format as;
+    runheader meta;
+  };
+  struct logfile {
+    std::unique_ptr<logstore> out;  // CSV files
+    std::unique_ptr<runwriter> run;
+    std::unique_ptr<runlog> segments;
+    std::string buffer;
+    unsigned long long lines = 0;
+  };
+  int openTarget(const target& t);
+  void push(const entry& e);
+  void run();
+  void flush(logfile& f);
+  // Flushes and closes `f`.
+  void shut(logfile& f);
+  // Accounts for `lines` written since `begin`.
+  void wrote(std::chrono::steady_clock::time_point begin,
+             unsigned long long lines);
+
+  std::thread worker;
+  std::atomic<bool> running{true};
+  std::atomic<double> interval;
+  int next_file = 0;
+  // Paths and headers of files not yet opened by the writer.
+  std::mutex mtx;
+  std::map<int, target> pending;
+  // Owned by the writer thread.
+  std::map<int, logfile> files;
+  std::atomic<size_t> max_depth{0};
+  std::atomic<double> write_ms{0.0};
+  std::atomic<double> max_write_ms{0.0};
+  std::atomic<unsigned long long> written{0};
+  spscring<entry, 4096> ring;
+};
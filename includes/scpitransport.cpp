@@ -0,0 +1,276 @@
+﻿#include "scpitransport.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <iostream>
+#include <string>
+
+#ifdef VISALIB_USE_VISA
+#include "visa.h"
+#endif
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <chrono>
+#endif
+
+#ifdef VISALIB_USE_VISA
+class visatransport : public scpitransport {
+ public:
+  visatransport() : defaultRM(VI_NULL), instr(VI_NULL) {}
+  ~visatransport() {
+    viClose(instr);
+    viClose(defaultRM);
+  }
+
+  bool open(const char* deviceName) {
+    if (viOpenDefaultRM(&defaultRM) < VI_SUCCESS) {
+      std::cout << "Could not open a session to the VISA Resource Manager!"
+                << std::endl;
+      return false;
+    }
+
+    if (viOpen(defaultRM, (ViRsrc)deviceName, VI_NO_LOCK, 0, &instr) <
+        VI_SUCCESS) {
+      std::cout << "Cannot open a session to the device." << std::endl;
+      return false;
+    }
+
+    viSetAttribute(instr, VI_ATTR_TMO_VALUE, 5000);
+    viSetAttribute(instr, VI_ATTR_ASRL_BAUD, 115200);
+    viSetAttribute(instr, VI_ATTR_ASRL_DATA_BITS, 8);
+    viSetAttribute(instr, VI_ATTR_ASRL_PARITY, VI_ASRL_PAR_NONE);
+    viSetAttribute(instr, VI_ATTR_ASRL_STOP_BITS, VI_ASRL_STOP_ONE);
+    viSetAttribute(instr, VI_ATTR_TERMCHAR_EN, VI_TRUE);
+    viSetAttribute(instr, VI_ATTR_TERMCHAR, 0xA);
+    return true;
+  }
+
+  bool write(const char* data, unsigned int length) {
+    ViUInt32 count = 0;
+    viWrite(instr, (ViBuf)data, length, &count);
+    return count == length;
+  }
+
+  int readLine(char* buffer, unsigned int maxLength) {
+    ViUInt32 count = 0;
+    if (viRead(instr, (ViPBuf)buffer, maxLength - 1, &count) < VI_SUCCESS) {
+      return -1;
+    }
+    while (count > 0 &&
+           (buffer[count - 1] == '\n' || buffer[count - 1] == '\r')) {
+      count--;
+    }
+    buffer[count] = '\0';
+    return count;
+  }
+
+ private:
+  ViSession defaultRM;
+  ViSession instr;
+};
+#endif
+
+#ifndef _WIN32
+// Non-blocking file descriptor with a line-buffered reader; shared by the
+// serial and TCP backends.
+class fdtransport : public scpitransport {
+ public:
+  ~fdtransport() {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+
+  bool write(const char* data, unsigned int length) {
+    unsigned int written = 0;
+    while (written < length) {
+      const ssize_t n = ::write(fd, data + written, length - written);
+      if (n > 0) {
+        written += n;
+        continue;
+      }
+      if (n < 0 && errno != EAGAIN && errno != EINTR) {
+        return false;
+      }
+      pollfd pfd = {fd, POLLOUT, 0};
+      if (poll(&pfd, 1, 5000) <= 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // 5 s timeout, matching VI_ATTR_TMO_VALUE on the VISA backend.
+  int readLine(char* buffer, unsigned int maxLength) {
+    const auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::milliseconds(5000);
+    while (true) {
+      const size_t eol = pending.find('\n');
+      if (eol != std::string::npos) {
+        size_t length = eol;
+        if (length > 0 && pending[length - 1] == '\r') {
+          length--;
+        }
+        if (length > maxLength - 1) {
+          length = maxLength - 1;
+        }
+        memcpy(buffer, pending.data(), length);
+        buffer[length] = '\0';
+        pending.erase(0, eol + 1);
+        return (int)length;
+      }
+      char chunk[256];
+      const ssize_t n = read(fd, chunk, sizeof(chunk));
+      if (n > 0) {
+        pending.append(chunk, n);
+        continue;
+      }
+      // A raw tty with VMIN = 0 reports "no data" as 0; a socket means EOF.
+      if ((n == 0 && socket_eof) ||
+          (n < 0 && errno != EAGAIN && errno != EINTR)) {
+        return -1;
+      }
+      const int wait_ms =
+          (int)std::chrono::duration_cast<std::chrono::milliseconds>(
+              deadline - std::chrono::steady_clock::now())
+              .count();
+      pollfd pfd = {fd, POLLIN, 0};
+      if (wait_ms <= 0 || poll(&pfd, 1, wait_ms) <= 0) {
+        return -1;
+      }
+    }
+  }
+
+ protected:
+  int fd = -1;
+  bool socket_eof = false;
+  std::string pending;
+};
+
+class serialtransport : public fdtransport {
+ public:
+  bool open(const char* path) {
+    socket_eof = false;
+    fd = ::open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+      std::cout << "打开串口" << path << "失败!" << std::endl;
+      return false;
+    }
+    termios tty;
+    if (tcgetattr(fd, &tty) != 0) {
+      std::cout << "获取串口通信状态失败！" << std::endl;
+      return false;
+    }
+    cfmakeraw(&tty);
+    cfsetispeed(&tty, B115200);
+    cfsetospeed(&tty, B115200);
+    tty.c_cflag &= ~(CSTOPB | PARENB | CRTSCTS | CSIZE);
+    tty.c_cflag |= CS8 | CLOCAL | CREAD;
+    tty.c_cc[VMIN] = 0;
+    tty.c_cc[VTIME] = 0;
+    if (tcsetattr(fd, TCSANOW, &tty) != 0) {
+      std::cout << "串口通信设置失败！" << std::endl;
+      return false;
+    }
+    tcflush(fd, TCIOFLUSH);
+    return true;
+  }
+};
+
+class tcptransport : public fdtransport {
+ public:
+  bool open(const std::string& host, const std::string& port) {
+    socket_eof = true;
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* res = NULL;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0) {
+      std::cout << "无法解析地址 " << host << std::endl;
+      return false;
+    }
+    for (addrinfo* ai = res; ai != NULL; ai = ai->ai_next) {
+      fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC,
+                  ai->ai_protocol);
+      if (fd < 0) {
+        continue;
+      }
+      if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+        break;
+      }
+      close(fd);
+      fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd < 0) {
+      std::cout << "连接 " << host << ":" << port << " 失败!" << std::endl;
+      return false;
+    }
+    // SCPI commands are tiny; do not let Nagle hold them back.
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return true;
+  }
+};
+#endif
+
+scpitransport* scpitransport::open(const char* resource) {
+  const std::string name = resource;
+#ifndef _WIN32
+  if (name.compare(0, 5, "TCPIP") == 0) {
+    // TCPIP[n]::host::port::SOCKET
+    const size_t first = name.find("::");
+    const size_t host_begin = first + 2;
+    const size_t host_end = first == std::string::npos
+                                ? std::string::npos
+                                : name.find("::", host_begin);
+    if (host_end == std::string::npos) {
+      std::cout << "无效的设备地址 " << name << std::endl;
+      return nullptr;
+    }
+    const size_t port_end = name.find("::", host_end + 2);
+    tcptransport* tcp = new tcptransport();
+    if (!tcp->open(name.substr(host_begin, host_end - host_begin),
+                   name.substr(host_end + 2, port_end - host_end - 2))) {
+      delete tcp;
+      return nullptr;
+    }
+    return tcp;
+  }
+  std::string path = name;
+  if (path.compare(0, 4, "ASRL") == 0) {
+    path = path.substr(4, path.find("::") - 4);
+  }
+  if (!path.empty() && path[0] == '/') {
+    serialtransport* serial = new serialtransport();
+    if (!serial->open(path.c_str())) {
+      delete serial;
+      return nullptr;
+    }
+    return serial;
+  }
+#endif
+#ifdef VISALIB_USE_VISA
+  visatransport* visa = new visatransport();
+  if (!visa->open(resource)) {
+    delete visa;
+    return nullptr;
+  }
+  return visa;
+#else
+  std::cout << "不支持的设备地址 " << name << std::endl;
+  return nullptr;
+#endif
+}
@@ -0,0 +1,23 @@
+﻿#pragma once
+#if defined(_WIN32) && !defined(VISALIB_NO_VISA)
+#define VISALIB_USE_VISA
+#endif
+
+// Byte transport for SCPI instruments. visalib talks to the supply through
+// this interface so the same command code runs over NI-VISA on the lab PCs
+// and over a plain serial port or TCP socket elsewhere.
+class scpitransport {
+ public:
+  virtual ~scpitransport() {}
+  virtual bool write(const char* data, unsigned int length) = 0;
+  // Reads one '\n'-terminated response into buffer (terminator stripped,
+  // result NUL-terminated). Returns the length or -1 on error/timeout.
+  virtual int readLine(char* buffer, unsigned int maxLength) = 0;
+
+  // Picks a backend from a VISA-style resource name:
+  //   "ASRL4::INSTR"                  -> NI-VISA (Windows)
+  //   "ASRL/dev/ttyUSB0::INSTR", "/dev/ttyUSB0"  -> termios serial
+  //   "TCPIP0::127.0.0.1::5025::SOCKET"          -> TCP socket
+  // Returns nullptr if the device cannot be opened.
+  static scpitransport* open(const char* resource);
+};
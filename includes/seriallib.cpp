@@ -1,5 +1,26 @@
 ﻿#include "seriallib.hpp"
 
+#include <string.h>
+
+#include <memory>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/serial.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <future>
+
+#include "reactor.hpp"
+#endif
+
+#ifdef _WIN32
 seriallib::seriallib(char* portName) : gszPort(portName) {
   openDevice();
   setRemote();
@@ -36,6 +57,16 @@ int seriallib::readBytes(void* buffer, unsigned int maxNbBytes) {
   // std::cout << dwBytesRead << std::endl;
   return dwBytesRead;
 }
+int seriallib::readTail(void* buffer, unsigned int maxNbBytes) {
+  COMMTIMEOUTS tail = timeouts;
+  tail.ReadTotalTimeoutConstant = 50;
+  tail.ReadTotalTimeoutMultiplier = 0;
+  SetCommTimeouts(hComm, &tail);
+  const int n = readBytes(buffer, maxNbBytes);
+  SetCommTimeouts(hComm, &timeouts);
+  return n;
+}
+
 bool seriallib::openDevice() {
   hComm = CreateFileA(gszPort, GENERIC_READ | GENERIC_WRITE, 0, 0,
                       OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
@@ -61,7 +92,8 @@ bool seriallib::openDevice() {
   SetupComm(hComm, 1000, 1000);
 
   // Set the Timeout parameters
-  timeouts.ReadIntervalTimeout = 1000;
+  // A frame is 26 bytes at 0.26 ms each; a 50 ms gap means it is over.
+  timeouts.ReadIntervalTimeout = 50;
   // No TimeOut
   timeouts.ReadTotalTimeoutConstant = 5000;
   timeouts.ReadTotalTimeoutMultiplier = 500;
@@ -76,149 +108,627 @@ bool seriallib::openDevice() {
   return true;
 }
 
-void seriallib::crc(unsigned char* Buffer) {
-  *(Buffer + 25) = std::accumulate(Buffer, Buffer + 24, 0) % 256;
+#else
+seriallib::seriallib(char* portName) : gszPort(portName) {
+  openDevice();
+  setRemote();
 }
 
-bool seriallib::readVCP(float* vcp) {
-  const unsigned char inputBuffer[26] = {
-      0xAA, 0x00, 0x5F, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x09};
-  if (writeBytes(inputBuffer) != 26) {
-    return false;
+// A null reactor opens the port for blocking use, as the other constructor.
+seriallib::seriallib(char* portName, reactor* io) : gszPort(portName), io(io) {
+  if (openDevice() && io != nullptr) {
+    io->add(fd, EPOLLIN, [this](uint32_t) { onReadable(); });
   }
-  unsigned char outputBuffer[26];
-  if (readBytes(outputBuffer) != 26) {
-    return false;
+  setRemote();
+}
+
+seriallib::~seriallib() {
+  setLocal();
+  if (io != nullptr && fd >= 0) {
+    io->remove(fd);
+    io->cancelTimer(timer);
+    io->cancelTimer(drain_timer);
+    io->cancelTimer(tail_timer);
+  }
+  if (fd >= 0) {
+    close(fd);
   }
-  vcp[0] = readHex(outputBuffer + 3) / 1000.0;
-  vcp[1] = readHex(outputBuffer + 7) / 10000.0;
-  vcp[2] = readHex(outputBuffer + 11) / 1000.0;
-  return true;
 }
 
-int seriallib::readHex(const unsigned char* Buffer) {
-  return Buffer[0] + Buffer[1] * 256 + Buffer[2] * 256 * 256 +
-         Buffer[3] * 256 * 256 * 256;
+int seriallib::writeBytes(const void* Buffer, const unsigned int NbBytes) {
+  const unsigned char* data = (const unsigned char*)Buffer;
+  unsigned int written = 0;
+  while (written < NbBytes) {
+    const ssize_t n = write(fd, data + written, NbBytes - written);
+    if (n > 0) {
+      written += n;
+      continue;
+    }
+    if (n < 0 && errno != EAGAIN && errno != EINTR) {
+      std::cout << written << " 写串口失败!" << std::endl;
+      return -1;
+    }
+    pollfd pfd = {fd, POLLOUT, 0};
+    if (poll(&pfd, 1, 2000) <= 0) {
+      std::cout << written << " 写串口失败!" << std::endl;
+      return -1;
+    }
+  }
+  return written;
 }
 
-bool seriallib::setRemote() {
-  const unsigned char inputBuffer[26] = {
-      0xAA, 0x00, 0x20, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00,
-      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xCB};
-  if (writeBytes(inputBuffer) != 26) {
+// Mirrors the Win32 COMMTIMEOUTS: 5 s + 500 ms per byte in total and 50 ms
+// between bytes once the reply has started.
+int seriallib::readBytes(void* buffer, unsigned int maxNbBytes) {
+  return readFor(buffer, maxNbBytes, 5000 + 500 * maxNbBytes);
+}
+
+int seriallib::readTail(void* buffer, unsigned int maxNbBytes) {
+  return readFor(buffer, maxNbBytes, 50);
+}
+
+int seriallib::readFor(void* buffer, unsigned int maxNbBytes, int total_ms) {
+  unsigned char* data = (unsigned char*)buffer;
+  unsigned int got = 0;
+  const auto deadline = std::chrono::steady_clock::now() +
+                        std::chrono::milliseconds(total_ms);
+  while (got < maxNbBytes) {
+    const ssize_t n = read(fd, data + got, maxNbBytes - got);
+    if (n > 0) {
+      got += n;
+      continue;
+    }
+    if (n < 0 && errno != EAGAIN && errno != EINTR) {
+      std::cout << got << " 读取失败！" << std::endl;
+      return -1;
+    }
+    int wait_ms = (int)std::chrono::duration_cast<std::chrono::milliseconds>(
+                      deadline - std::chrono::steady_clock::now())
+                      .count();
+    if (got > 0 && wait_ms > 50) {
+      wait_ms = 50;
+    }
+    if (wait_ms <= 0) {
+      break;
+    }
+    pollfd pfd = {fd, POLLIN, 0};
+    if (poll(&pfd, 1, wait_ms) == 0) {
+      break;
+    }
+  }
+  return got;
+}
+
+bool seriallib::openDevice() {
+  fd = open(gszPort, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0) {
+    std::cout << "failed to open serial port " << gszPort << " 打开串口"
+              << gszPort << "失败!" << std::endl;
     return false;
   }
-  unsigned char outputBuffer[26];
-  if (readBytes(outputBuffer) != 26) {
+  if (tcgetattr(fd, &tty) != 0) {
+    std::cout << "获取串口通信状态失败！" << std::endl;
+    return false;
+  }
+  cfmakeraw(&tty);
+  cfsetispeed(&tty, B38400);
+  cfsetospeed(&tty, B38400);
+  tty.c_cflag &= ~(CSTOPB | PARENB | CRTSCTS | CSIZE);
+  tty.c_cflag |= CS8 | CLOCAL | CREAD;
+  tty.c_cc[VMIN] = 0;
+  tty.c_cc[VTIME] = 0;
+  if (tcsetattr(fd, TCSANOW, &tty) != 0) {
+    std::cout << "串口通信设置失败！" << std::endl;
     return false;
   }
+  tcflush(fd, TCIOFLUSH);
+
+  // USB adapters batch input for up to 16 ms by default; ask the driver to
+  // hand bytes over immediately. Not every driver supports this.
+  serial_struct serial;
+  if (ioctl(fd, TIOCGSERIAL, &serial) == 0) {
+    serial.flags |= ASYNC_LOW_LATENCY;
+    ioctl(fd, TIOCSSERIAL, &serial);
+  }
   return true;
 }
 
-bool seriallib::setLocal() {
-  const unsigned char inputBuffer[26] = {
-      0xAA, 0x00, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xCA};
-  if (writeBytes(inputBuffer) != 26) {
-    return false;
+void seriallib::transactAsync(const unsigned char* command,
+                              unsigned char* response, completion done) {
+  pending p;
+  memcpy(p.command, command, 26);
+  p.response = response;
+  p.done = std::move(done);
+  {
+    std::lock_guard<std::mutex> lock(bus);
+    queue.push_back(std::move(p));
   }
-  unsigned char outputBuffer[26];
-  if (readBytes(outputBuffer) != 26) {
-    return false;
+  io->post([this]() { pump(); });
+}
+
+// Runs on the reactor thread. The first `inflight` entries of the queue have
+// been written and await replies, which the load returns in order; up to
+// `depth` commands are kept on the wire at once.
+void seriallib::pump() {
+  while (true) {
+    const unsigned char* command;
+    {
+      std::lock_guard<std::mutex> lock(bus);
+      if (draining || inflight >= depth || inflight >= (int)queue.size()) {
+        break;
+      }
+      if (inflight == 0) {
+        parser.dropPending();
+      }
+      command = queue[inflight].command;
+      inflight++;
+    }
+    if (writeBytes(command) != 26) {
+      completion done;
+      {
+        std::lock_guard<std::mutex> lock(bus);
+        inflight--;
+        done = std::move(queue[inflight].done);
+        queue.erase(queue.begin() + inflight);
+      }
+      if (done) {
+        done(false);
+      }
+    }
   }
-  return true;
+  armTimeout();
 }
 
-bool seriallib::loadOn() {
-  const unsigned char inputBuffer[26] = {
-      0xAA, 0x00, 0x21, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00,
-      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xCC};
-  if (writeBytes(inputBuffer) != 26) {
-    return false;
+// One timeout, always for the oldest outstanding command.
+void seriallib::armTimeout() {
+  if (timer != 0) {
+    io->cancelTimer(timer);
+    timer = 0;
   }
-  unsigned char outputBuffer[26];
-  if (readBytes(outputBuffer) != 26) {
+  {
+    std::lock_guard<std::mutex> lock(bus);
+    if (inflight == 0) {
+      return;
+    }
+  }
+  timer = io->addTimer(5.0, [this]() {
+    timer = 0;
+    {
+      std::lock_guard<std::mutex> lock(bus);
+      parser.countTimeout();
+      publishStats();
+    }
+    std::cout << "读取失败！" << std::endl;
+    complete(false);
+  });
+}
+
+void seriallib::onReadable() {
+  while (true) {
+    bool ready = false;
+    int failed = 0;
+    {
+      std::lock_guard<std::mutex> lock(bus);
+      unsigned char chunk[64];
+      ssize_t n;
+      bool got = false;
+      while ((n = read(fd, chunk, sizeof(chunk))) > 0) {
+        parser.feed(chunk, n);
+        got = true;
+      }
+      if (damagedLocked()) {
+        failed = inflight;
+      }
+      if (draining) {
+        parser.dropPending();
+        if (got || failed > 0) {
+          armDrain();
+        }
+      } else {
+        it8512codec::frame frame;
+        if (inflight > 0 && parser.next(frame)) {
+          if (it8512codec::answers(frame, queue.front().command[2])) {
+            memcpy(queue.front().response, frame.data(), 26);
+            ready = true;
+            armTail();
+          } else {
+            // The reply of an earlier command went missing and this one
+            // belongs further down the queue.
+            failed = inflight;
+            draining = true;
+            parser.dropPending();
+            armDrain();
+          }
+        } else {
+          armTail();
+        }
+      }
+      publishStats();
+    }
+    for (int i = 0; i < failed; i++) {
+      complete(false);
+    }
+    if (!ready) {
+      break;
+    }
+    complete(true);
+  }
+}
+
+// Called with bus held. Replies come back in order, but a damaged one cannot
+// be told apart from the next, so any damage fails everything outstanding
+// and the port resynchronizes once the line goes quiet.
+bool seriallib::damagedLocked() {
+  const it8512parser::counters c = parser.stats();
+  const unsigned long long damage = c.corrupted + c.discarded;
+  if (damage == last_damage) {
     return false;
   }
+  last_damage = damage;
+  draining = true;
   return true;
 }
-bool seriallib::loadOff() {
-  const unsigned char inputBuffer[26] = {
-      0xAA, 0x00, 0x21, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xCB};
-  if (writeBytes(inputBuffer) != 26) {
+
+// Called with bus held.
+void seriallib::armDrain() {
+  if (drain_timer != 0) {
+    io->cancelTimer(drain_timer);
+  }
+  drain_timer = io->addTimer(0.05, [this]() {
+    drain_timer = 0;
+    {
+      std::lock_guard<std::mutex> lock(bus);
+      draining = false;
+      parser.dropPending();
+    }
+    pump();
+  });
+}
+
+// Called with bus held. A partial frame followed by 50 ms of silence was cut
+// short on the wire; treat it like any other damage.
+void seriallib::armTail() {
+  if (tail_timer != 0) {
+    io->cancelTimer(tail_timer);
+    tail_timer = 0;
+  }
+  if (parser.buffered() == 0) {
+    return;
+  }
+  tail_timer = io->addTimer(0.05, [this]() {
+    tail_timer = 0;
+    int failed = 0;
+    {
+      std::lock_guard<std::mutex> lock(bus);
+      parser.countTimeout();
+      if (damagedLocked()) {
+        failed = inflight;
+        armDrain();
+      }
+      publishStats();
+    }
+    for (int i = 0; i < failed; i++) {
+      complete(false);
+    }
+  });
+}
+
+void seriallib::complete(bool ok) {
+  completion done;
+  {
+    std::lock_guard<std::mutex> lock(bus);
+    if (inflight == 0) {
+      return;
+    }
+    done = std::move(queue.front().done);
+    queue.pop_front();
+    inflight--;
+  }
+  if (done) {
+    done(ok);
+  }
+  pump();
+}
+
+#endif
+
+bool seriallib::transact(const unsigned char* command,
+                         unsigned char* response) {
+#ifndef _WIN32
+  if (io != nullptr) {
+    if (io->inLoopThread()) {
+      std::cout << "不能在事件循环线程中同步读写串口!" << std::endl;
+      return false;
+    }
+    std::shared_ptr<std::promise<bool>> result =
+        std::make_shared<std::promise<bool>>();
+    std::future<bool> ok = result->get_future();
+    transactAsync(command, response,
+                  [result](bool success) { result->set_value(success); });
+    if (ok.wait_for(std::chrono::seconds(6)) != std::future_status::ready) {
+      std::cout << "串口事件循环无响应!" << std::endl;
+      return false;
+    }
+    return ok.get();
+  }
+#endif
+  // The acquisition thread, the sweep thread and the UI share one port; a
+  // command and its reply must not interleave with another caller's.
+  std::lock_guard<std::mutex> lock(bus);
+  parser.dropPending();
+  if (writeBytes(command) != 26) {
     return false;
   }
-  unsigned char outputBuffer[26];
-  if (readBytes(outputBuffer) != 26) {
+  return readFrame(command[2], response);
+}
+
+void seriallib::setPipelineDepth(int depth) {
+  std::lock_guard<std::mutex> lock(bus);
+  this->depth = depth < 1 ? 1 : depth;
+}
+
+int seriallib::pipeline(const it8512codec::frame* commands,
+                        it8512codec::frame* replies, bool* ok, int count) {
+#ifndef _WIN32
+  if (io != nullptr) {
+    struct batch {
+      std::mutex mtx;
+      std::condition_variable cv;
+      int remaining;
+      bool failed = false;
+    };
+    std::shared_ptr<batch> b = std::make_shared<batch>();
+    b->remaining = count;
+    for (int i = 0; i < count; i++) {
+      ok[i] = false;
+      // Completions run in order; once one fails, so does the rest of the
+      // batch, as in the blocking path below.
+      transactAsync(commands[i].data(), replies[i].data(),
+                    [b, ok, i](bool success) {
+                      std::lock_guard<std::mutex> lock(b->mtx);
+                      b->failed = b->failed || !success;
+                      ok[i] = !b->failed;
+                      if (--b->remaining == 0) {
+                        b->cv.notify_all();
+                      }
+                    });
+    }
+    std::unique_lock<std::mutex> lock(b->mtx);
+    b->cv.wait(lock, [&b]() { return b->remaining == 0; });
+    int good = 0;
+    for (int i = 0; i < count; i++) {
+      good += ok[i] ? 1 : 0;
+    }
+    return good;
+  }
+#endif
+  std::lock_guard<std::mutex> lock(bus);
+  parser.dropPending();
+  int sent = 0;
+  int good = 0;
+  for (int done = 0; done < count; done++) {
+    while (sent < count && sent - done < depth) {
+      ok[sent] = writeBytes(commands[sent].data()) == 26;
+      sent++;
+    }
+    if (!ok[done]) {
+      continue;
+    }
+    const it8512parser::counters before = parser.stats();
+    ok[done] = readFrame(commands[done][2], replies[done].data(), true);
+    const it8512parser::counters after = parser.stats();
+    // Any damage while this reply was read may have been this reply, in
+    // which case the frame just matched belongs to the next request.
+    if (after.corrupted + after.discarded !=
+        before.corrupted + before.discarded) {
+      ok[done] = false;
+    }
+    if (ok[done]) {
+      good++;
+    } else {
+      // A lost or misplaced reply would shift every later reply onto the
+      // wrong request; give up on the rest of the batch and start clean.
+      for (int k = done + 1; k < count; k++) {
+        ok[k] = false;
+      }
+      drain();
+      break;
+    }
+  }
+  return good;
+}
+
+// Called with bus held. Discards replies still on their way until the line
+// has been quiet for one inter-byte timeout.
+void seriallib::drain() {
+  unsigned char scratch[64];
+  while (readTail(scratch, sizeof(scratch)) > 0) {
+  }
+  parser.dropPending();
+}
+
+// Called with bus held. Reads only as many bytes as the frame being
+// assembled still needs, so a dropped or extra byte is resynchronized on the
+// next header instead of shifting every following reply. `in_order` takes
+// the next frame as the reply and fails if it does not answer `expected`,
+// where a lone transaction skips late replies to earlier ones.
+bool seriallib::readFrame(unsigned char expected, unsigned char* response,
+                          bool in_order) {
+  it8512codec::frame frame;
+  bool started = false;
+  while (!(in_order ? parser.next(frame) : parser.reply(expected, frame))) {
+    unsigned char chunk[26];
+    // Once the reply has started, a silent line means the frame was damaged
+    // and nothing more is coming; do not wait out the full read timeout.
+    const int n = started ? readTail(chunk, parser.needed())
+                          : readBytes(chunk, parser.needed());
+    started = true;
+    if (n <= 0) {
+      parser.countTimeout();
+      publishStats();
+      return false;
+    }
+    parser.feed(chunk, n);
+  }
+  publishStats();
+  if (!it8512codec::answers(frame, expected)) {
     return false;
   }
+  memcpy(response, frame.data(), 26);
   return true;
 }
 
-bool seriallib::setCurrent(float current) {
-  unsigned char inputBuffer[26] = {0xAA, 0x00, 0x2A, 0x00, 0x00, 0x00, 0x00,
-                                   0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-                                   0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-                                   0x00, 0x00, 0x00, 0x00, 0x00};
-  const unsigned int current_int = (unsigned int)(current * 10000);
-  inputBuffer[3] = current_int % 256;
-  inputBuffer[4] = current_int >> 8 % 256;
-  inputBuffer[5] = current_int >> 16 % 256;
-  inputBuffer[6] = current_int >> 24 % 256;
-  crc(inputBuffer);
-  if (writeBytes(inputBuffer) != 26) {
+// Served from a snapshot so the UI never waits behind a slow transaction.
+it8512parser::counters seriallib::linkStats() {
+  std::lock_guard<std::mutex> lock(stats_mutex);
+  return published;
+}
+
+void seriallib::publishStats() {
+  std::lock_guard<std::mutex> lock(stats_mutex);
+  published = parser.stats();
+}
+
+void seriallib::crc(unsigned char* Buffer) {
+  *(Buffer + 25) = std::accumulate(Buffer, Buffer + 24, 0) % 256;
+}
+
+bool seriallib::readVCP(float* vcp) {
+  unsigned char outputBuffer[26];
+  if (!transact(it8512codec::fixed<it8512codec::READ_VCP>::value.data(),
+                outputBuffer)) {
     return false;
   }
-  unsigned char outputBuffer[26];
-  if (readBytes(outputBuffer) != 26) {
+  const it8512codec::reply r = it8512codec::decode(outputBuffer);
+  if (!r.valid || r.command != it8512codec::READ_VCP) {
+    std::cout << "电子负载应答无效!" << std::endl;
     return false;
   }
+  vcp[0] = r.voltage;
+  vcp[1] = r.current;
+  vcp[2] = r.power;
   return true;
 }
 
-bool seriallib::setVoltage(float voltage) {
-  unsigned char inputBuffer[26] = {0xAA, 0x00, 0x2C, 0x00, 0x00, 0x00, 0x00,
-                                   0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-                                   0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-                                   0x00, 0x00, 0x00, 0x00, 0x00};
-  const unsigned int voltage_int = (unsigned int)(voltage * 1000);
-  inputBuffer[3] = voltage_int % 256;
-  inputBuffer[4] = voltage_int >> 8 % 256;
-  inputBuffer[5] = voltage_int >> 16 % 256;
-  inputBuffer[6] = voltage_int >> 24 % 256;
-  crc(inputBuffer);
-  if (writeBytes(inputBuffer) != 26) {
+int seriallib::readHex(const unsigned char* Buffer) {
+  return Buffer[0] + Buffer[1] * 256 + Buffer[2] * 256 * 256 +
+         Buffer[3] * 256 * 256 * 256;
+}
+
+bool seriallib::command(const it8512codec::frame& frame) {
+  unsigned char outputBuffer[26];
+  if (!transact(frame.data(), outputBuffer)) {
     return false;
   }
-  unsigned char outputBuffer[26];
-  if (readBytes(outputBuffer) != 26) {
+  const it8512codec::reply r = it8512codec::decode(outputBuffer);
+  if (!r.valid || r.command != it8512codec::STATUS) {
+    std::cout << "电子负载应答无效!" << std::endl;
+    return false;
+  }
+  if (r.status != it8512codec::OK) {
+    std::cout << "电子负载拒绝命令 0x" << std::hex << (int)frame[2]
+              << " 状态 0x" << (int)r.status << std::dec << std::endl;
     return false;
   }
   return true;
 }
 
+bool seriallib::setRemote() {
+  return command(it8512codec::fixed<it8512codec::REMOTE, 1>::value);
+}
+
+bool seriallib::setLocal() {
+  return command(it8512codec::fixed<it8512codec::REMOTE, 0>::value);
+}
+
+bool seriallib::loadOn() {
+  return command(it8512codec::fixed<it8512codec::LOAD, 1>::value);
+}
+
+bool seriallib::loadOff() {
+  return command(it8512codec::fixed<it8512codec::LOAD, 0>::value);
+}
+
+bool seriallib::setCurrent(float current) {
+  return command(it8512codec::current(current));
+}
+
+bool seriallib::setVoltage(float voltage) {
+  return command(it8512codec::voltage(voltage));
+}
+
+bool seriallib::setPower(float power) {
+  return command(it8512codec::power(power));
+}
+
+bool seriallib::setResistance(float resistance) {
+  return command(it8512codec::resistance(resistance));
+}
+
+// 0 = CC, 1 = CV, 2 = CW, 3 = CR.
 bool seriallib::setLoadType(int load_type) {
-  unsigned char inputBuffer[26] = {0xAA, 0x00, 0x28, 0x00, 0x00, 0x00, 0x00,
-                                   0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-                                   0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-                                   0x00, 0x00, 0x00, 0x00, 0xD2};
-  if (load_type == 1) {
-    inputBuffer[3] = 0x01;
-    inputBuffer[25] = 0xD3;
-  }
-  if (writeBytes(inputBuffer) != 26) {
-    return false;
+  switch (load_type) {
+    case it8512codec::CV:
+      return command(it8512codec::fixed<it8512codec::MODE, 1>::value);
+    case it8512codec::CW:
+      return command(it8512codec::fixed<it8512codec::MODE, 2>::value);
+    case it8512codec::CR:
+      return command(it8512codec::fixed<it8512codec::MODE, 3>::value);
+    default:
+      return command(it8512codec::fixed<it8512codec::MODE, 0>::value);
   }
-  unsigned char outputBuffer[26];
-  if (readBytes(outputBuffer) != 26) {
+}
+
+bool seriallib::uploadList(int load_type, const float* values,
+                           const float* seconds, int count, bool repeat) {
+  if (load_type != it8512codec::CC && load_type != it8512codec::CV) {
+    std::cout << "列表模式仅支持定电流和定电压!" << std::endl;
     return false;
   }
+  std::vector<it8512codec::frame> frames;
+  frames.push_back(
+      it8512codec::make(it8512codec::FUNCTION, it8512codec::FIXED));
+  frames.push_back(it8512codec::make(it8512codec::LIST_MODE,
+                                     (unsigned char)load_type));
+  frames.push_back(it8512codec::make(it8512codec::LIST_REPEAT, repeat ? 1 : 0));
+  frames.push_back(it8512codec::listSteps(0));
+  uint16_t step = 0;
+  for (int i = 0; i < count; i++) {
+    float left = seconds[i];
+    do {
+      const float t =
+          left > it8512codec::list_step_max ? it8512codec::list_step_max : left;
+      frames.push_back(load_type == it8512codec::CC
+                           ? it8512codec::listCurrent(step, values[i], t)
+                           : it8512codec::listVoltage(step, values[i], t));
+      step++;
+      left -= t;
+    } while (left > 0.0001f);
+  }
+  frames[3] = it8512codec::listSteps(step);
+  frames.push_back(it8512codec::make(it8512codec::TRIGGER_SOURCE,
+                                     it8512codec::TRIGGER_BUS));
+  frames.push_back(it8512codec::make(it8512codec::FUNCTION, it8512codec::LIST));
+
+  std::vector<it8512codec::frame> replies(frames.size());
+  std::unique_ptr<bool[]> ok(new bool[frames.size()]);
+  pipeline(frames.data(), replies.data(), ok.get(), (int)frames.size());
+  for (size_t i = 0; i < frames.size(); i++) {
+    if (!ok[i] ||
+        !it8512codec::accepted(it8512codec::decode(replies[i].data()))) {
+      std::cout << "上传负载列表失败! 命令 0x" << std::hex << (int)frames[i][2]
+                << std::dec << std::endl;
+      return false;
+    }
+  }
   return true;
-}
\ No newline at end of file
+}
+
+bool seriallib::trigger() {
+  return command(it8512codec::fixed<it8512codec::TRIGGER>::value);
+}
+
+bool seriallib::stopList() {
+  return command(
+      it8512codec::fixed<it8512codec::FUNCTION, it8512codec::FIXED>::value);
+}
@@ -1,13 +1,32 @@
 ﻿#pragma once
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include <termios.h>
+#endif
 
+#include <deque>
+#include <functional>
 #include <iostream>
+#include <mutex>
 #include <numeric>
 #include <vector>
 
+#include "it8512codec.hpp"
+#include "it8512parser.hpp"
+
+#ifndef _WIN32
+class reactor;
+#endif
+
 class seriallib {
  public:
   seriallib(char* portName);
+#ifndef _WIN32
+  // Ports opened with a reactor run every transaction asynchronously on the
+  // reactor thread; the blocking methods below then wait on the result.
+  seriallib(char* portName, reactor* io);
+#endif
   ~seriallib();
   int writeBytes(const void* Buffer, const unsigned int NbBytes = 26);
   int readBytes(void* buffer, unsigned int maxNbBytes = 26);
@@ -18,14 +37,79 @@ class seriallib {
   bool loadOff();
   bool setCurrent(float current);
   bool setVoltage(float voltage);
+  bool setPower(float power);
+  bool setResistance(float resistance);
   bool setLoadType(int load_type);
+  // List mode: the load steps through the setpoints (CC for load_type 0, CV
+  // for 1) on its own clock once triggered. Steps longer than one list entry
+  // allows are split over several entries. Leaves the load in list mode
+  // waiting for a bus trigger.
+  bool uploadList(int load_type, const float* values, const float* seconds,
+                  int count, bool repeat = false);
+  bool trigger();
+  bool stopList();
+  it8512parser::counters linkStats();
+  // Sends count commands keeping up to the pipeline depth on the wire at
+  // once and collects the replies, which the load returns in order, into
+  // replies[i]/ok[i]. Returns the number of successful transactions.
+  int pipeline(const it8512codec::frame* commands,
+               it8512codec::frame* replies, bool* ok, int count);
+  void setPipelineDepth(int depth);
+#ifndef _WIN32
+  typedef std::function<void(bool ok)> completion;
+  // Queues one 26-byte command; done runs on the reactor thread once the
+  // 26-byte reply has been read into response or the read timed out.
+  void transactAsync(const unsigned char* command, unsigned char* response,
+                     completion done);
+  // True for ports opened with a reactor.
+  bool async() const { return io != nullptr; }
+#endif
 
  private:
+#ifdef _WIN32
   LPCSTR gszPort;
   HANDLE hComm;
   DCB dcb = {0};
   COMMTIMEOUTS timeouts;
+#else
+  struct pending {
+    unsigned char command[26];
+    unsigned char* response;
+    completion done;
+  };
+  const char* gszPort;
+  int fd = -1;
+  termios tty;
+  reactor* io = nullptr;
+  std::deque<pending> queue;
+  int timer = 0;
+  int readFor(void* buffer, unsigned int maxNbBytes, int total_ms);
+  int inflight = 0;
+  bool draining = false;
+  int drain_timer = 0;
+  int tail_timer = 0;
+  unsigned long long last_damage = 0;
+  void pump();
+  void armTimeout();
+  void onReadable();
+  bool damagedLocked();
+  void armDrain();
+  void armTail();
+  void complete(bool ok);
+#endif
+  std::mutex bus;
+  int depth = 1;
+  it8512parser parser;
+  std::mutex stats_mutex;
+  it8512parser::counters published = {};
+  void publishStats();
   bool openDevice();
+  bool readFrame(unsigned char expected, unsigned char* response,
+                 bool in_order = false);
+  int readTail(void* buffer, unsigned int maxNbBytes);
+  void drain();
+  bool transact(const unsigned char* command, unsigned char* response);
+  bool command(const it8512codec::frame& frame);
   bool setRemote();
   bool setLocal();
 };
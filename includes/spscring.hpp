@@ -0,0 +1,54 @@
+﻿#pragma once
+#include <atomic>
+#include <cstddef>
+
+// Fixed-capacity single-producer/single-consumer ring. push() may only be
+// called from one thread and pop() from one other thread.
+template <typename T, size_t Capacity>
+class spscring {
+  static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                "Capacity must be a power of two");
+
+ public:
+  bool push(const T& item) {
+    const size_t write = write_index.load(std::memory_order_relaxed);
+    if (write - cached_read == Capacity) {
+      cached_read = read_index.load(std::memory_order_acquire);
+      if (write - cached_read == Capacity) {
+        return false;
+      }
+    }
+    buffer[write & (Capacity - 1)] = item;
+    write_index.store(write + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T& item) {
+    const size_t read = read_index.load(std::memory_order_relaxed);
+    if (read == cached_write) {
+      cached_write = write_index.load(std::memory_order_acquire);
+      if (read == cached_write) {
+        return false;
+      }
+    }
+    item = buffer[read & (Capacity - 1)];
+    read_index.store(read + 1, std::memory_order_release);
+    return true;
+  }
+
+  size_t size() const {
+    return write_index.load(std::memory_order_acquire) -
+           read_index.load(std::memory_order_acquire);
+  }
+
+  static constexpr size_t capacity() { return Capacity; }
+
+ private:
+  // Producer and consumer indices live on separate cache lines so the two
+  // threads do not false-share.
+  alignas(64) std::atomic<size_t> write_index{0};
+  size_t cached_read = 0;
+  alignas(64) std::atomic<size_t> read_index{0};
+  size_t cached_write = 0;
+  alignas(64) T buffer[Capacity];
+};
@@ -0,0 +1,151 @@
+﻿#include "station.hpp"
+
+#include <algorithm>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+std::vector<stationconfig> loadStations(const char* path) {
+  std::vector<stationconfig> stations;
+  std::ifstream in(path);
+  if (!in) {
+    stations.push_back(stationconfig{"1号台", "COM5", "ASRL4::INSTR"});
+    return stations;
+  }
+  std::string text;
+  while (std::getline(in, text)) {
+    const size_t comment = text.find('#');
+    if (comment != std::string::npos) {
+      text.erase(comment);
+    }
+    std::istringstream words(text);
+    stationconfig config;
+    if (!(words >> config.name)) {
+      continue;
+    }
+    if (!(words >> config.load_port >> config.psw_address)) {
+      std::cout << "测试台配置 " << config.name << " 缺少仪器地址!"
+                << std::endl;
+      continue;
+    }
+    stations.push_back(config);
+  }
+  return stations;
+}
+
+station::station(const stationconfig& config, const std::string& directory,
+                 reactor* io)
+    : config(config),
+      directory(directory),
+#ifdef _WIN32
+      it8512((char*)this->config.load_port.c_str()),
+#else
+      it8512((char*)this->config.load_port.c_str(), io),
+#endif
+      psw((char*)this->config.psw_address.c_str()),
+      load(&it8512, 4),
+      acq(&load, &psw) {
+  if (!it8512.loadOn() || !it8512.setLoadType(0)) {
+    std::cout << config.name << ": 打开电子负载失败!" << std::endl;
+  }
+  if (!psw.output(false)) {
+    std::cout << config.name << ": 关闭电源失败!" << std::endl;
+  }
+  std::error_code error;
+  std::filesystem::create_directories(directory, error);
+
+  time_t now = std::time(0);
+  tm* ltm = localtime(&now);
+  char filename[80];
+  sprintf(filename, "data%d-%d-%d-%d-%d-%d", ltm->tm_year + 1900,
+          ltm->tm_mon + 1, ltm->tm_mday, ltm->tm_hour, ltm->tm_min,
+          ltm->tm_sec);
+  data_path = path(filename);
+  data_log = logger.openSegments(data_path, header());
+  acq.setMode(mode);
+  acq.start();
+}
+
+station::~station() { acq.stop(); }
+
+runheader station::header() const {
+  runheader h = {};
+  h.mode = mode;
+  h.load_type = load_type;
+  h.sweep_type = sweep_type;
+  h.temperature = temperature;
+  h.fuel_flow = fuel_flow;
+  h.air_flow = air_flow;
+  h.started = (int64_t)std::time(0);
+  return h;
+}
+
+std::string station::path(const std::string& filename) const {
+  return directory + "\\" + filename;
+}
+
+void station::drain() {
+  // While a sweep runs, every sample also goes to its "_t.run" companion
+  // file.
+  if (str_filename != sweep_log_name) {
+    if (sweep_log >= 0) {
+      logger.close(sweep_log);
+      sweep_log = -1;
+    }
+    sweep_log_name = str_filename;
+    if (sweep_log_name.size() > 4) {
+      const std::string filename_t =
+          sweep_log_name.substr(0, sweep_log_name.size() - 4) + "_t.run";
+      sweep_log = logger.openRun(filename_t, header());
+    }
+  }
+  sample s;
+  while (acq.pop(s)) {
+    last_time = s.time;
+    time.push_back(last_time);
+    voltage.push_back(s.voltage);
+    current.push_back(s.current);
+    power.push_back(s.power);
+    hydrogen.push_back(s.hydrogen);
+    const logrecord r = {last_time, s.voltage,   s.current, s.power,
+                         s.hydrogen, s.mode,      temperature, fuel_flow,
+                         air_flow,  load_type};
+    logger.write(data_log, r);
+    if (sweep_log >= 0) {
+      logger.write(sweep_log, r);
+    }
+    if (current.size() > 1) {
+      smallest_c = (std::min)(current.back() - 0.03f, smallest_c);
+      biggest_c = (std::max)(current.back() + 0.03f, biggest_c);
+    } else if (current.size() == 1) {
+      smallest_c = current[0] - 0.03;
+      biggest_c = current[0] + 0.03;
+    }
+
+    if (voltage.size() > 1) {
+      smallest_v = (std::min)(voltage.back() - 0.03f, smallest_v);
+      biggest_v = (std::max)(voltage.back() + 0.03f, biggest_v);
+    } else if (voltage.size() == 1) {
+      smallest_v = voltage[0] - 0.03;
+      biggest_v = voltage[0] + 0.03;
+    }
+
+    if (power.size() > 1) {
+      smallest_p = (std::min)(power.back() - 0.03f, smallest_p);
+      biggest_p = (std::max)(power.back() + 0.03f, biggest_p);
+    } else if (power.size() == 1) {
+      smallest_p = power[0] - 0.03;
+      biggest_p = power[0] + 0.03;
+    }
+
+    if (hydrogen.size() > 1) {
+      smallest_h = (std::min)(hydrogen.back() - 0.03f, smallest_h);
+      biggest_h = (std::max)(hydrogen.back() + 0.03f, biggest_h);
+    } else if (hydrogen.size() == 1) {
+      smallest_h = hydrogen[0] - 0.03;
+      biggest_h = hydrogen[0] + 0.03;
+    }
+  }
+}
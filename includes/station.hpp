@@ -0,0 +1,110 @@
+﻿#pragma once
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "acquisition.hpp"
+#include "it8512queue.hpp"
+#include "samplelog.hpp"
+#include "seriallib.hpp"
+#include "steadystate.hpp"
+#include "stopsignal.hpp"
+#include "visalib.hpp"
+
+class reactor;
+
+// One load/supply pair from the station file.
+struct stationconfig {
+  std::string name;
+  std::string load_port;
+  std::string psw_address;
+};
+
+// Reads "name load_port psw_address" lines, '#' starting a comment. Without
+// a station file this is the single stack the app has always driven.
+std::vector<stationconfig> loadStations(const char* path);
+
+// Everything one test stack needs: its instruments, its own acquisition
+// thread and continuous log, the plot set and the state its sweep thread
+// works on. Stations share nothing, so each runs at the pace of its own
+// ports and N stacks need N times the ports, not N PCs.
+class station {
+ public:
+  // With a reactor (Linux) the load port runs on its thread instead of a
+  // queue thread of its own; the reactor must outlive the station.
+  station(const stationconfig& config, const std::string& directory,
+          reactor* io = nullptr);
+  ~station();
+  // Moves the samples acquired since the last frame into the plot set and
+  // hands them to the log writer.
+  void drain();
+  // `filename` inside this station's output directory.
+  std::string path(const std::string& filename) const;
+
+  stationconfig config;
+  std::string directory;
+  std::string label;  // tags the windows; empty with a single station
+  std::string data_path;  // segmented run of the continuous log; see runlog
+  seriallib it8512;
+  visalib psw;
+  it8512queue load;
+  acquisition acq;
+  samplelog logger;
+
+  // Shared with the sweep thread.
+  int mode = 0;
+  int load_type = 0;
+  float progress = 0.0f;
+  std::string str_filename = "";
+  stopsignal stop;
+  std::atomic<float> stop_latency{-1.0f};
+  float temperature = 700.0f;
+  float fuel_flow = 0.0f;
+  float air_flow = 20.0f;
+
+  // Test parameters entered in the UI.
+  int sweep_type = 0;
+  float set_current = 0.0f;
+  float ocv = 30.0f;
+  float occ = 0.0f;
+  float set_load_voltage = 30.0f;
+  float set_voltage = 0.0f;
+  int step = 20;
+  float step_time = 1.0;
+  int repeat = 1;
+  dwellsettings dwell;
+  bool refine = false;
+  bool on_instrument = false;
+  int refine_budget = 10;
+  char recipe_path[256] = "recipes\\example.txt";
+
+  // Continuous readings.
+  double last_time = 0.0;
+  std::vector<float> time;
+  std::vector<float> voltage;
+  std::vector<float> current;
+  std::vector<float> power;
+  std::vector<float> hydrogen;
+  float smallest_c = 0;
+  float biggest_c = 10;
+  float smallest_v = 0;
+  float biggest_v = 30;
+  float smallest_p = 0;
+  float biggest_p = 200;
+  float smallest_h = smallest_c / 26.801 / 2.0 * 23.8 * 20.0;
+  float biggest_h = biggest_c / 26.801 / 2.0 * 23.8 * 20.0;
+
+  // The current sweep.
+  std::vector<float> time_ivp;
+  std::vector<float> voltage_ivp;
+  std::vector<float> current_ivp;
+  std::vector<float> power_ivp;
+  std::vector<float> hydrogen_ivp;
+
+ private:
+  // Run metadata for a new log file from the current settings.
+  runheader header() const;
+  int data_log = -1;
+  int sweep_log = -1;
+  std::string sweep_log_name;  // str_filename that sweep_log belongs to
+};
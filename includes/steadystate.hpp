@@ -0,0 +1,66 @@
+﻿#pragma once
+#include <cmath>
+#include <deque>
+
+// Settings for ending a sweep step once the cell has settled instead of
+// after a fixed step time.
+struct dwellsettings {
+  bool adaptive = false;
+  float min_dwell = 0.5f;   // s
+  float max_dwell = 30.0f;  // s
+  float window = 1.0f;      // s of readings the slope is fitted over
+  float threshold = 0.005f; // V/s (current load) or A/s (voltage set)
+  float period = 0.05f;     // s between readings while dwelling
+};
+
+// Least-squares slope of the readings in a sliding time window. The step is
+// settled once the window is full and the slope is within the threshold.
+class steadystate {
+ public:
+  steadystate(double window, double threshold)
+      : window(window), threshold(threshold) {}
+
+  void add(double t, double y) {
+    points.push_back(point{t, y});
+    while (points.size() > 2 && t - points[1].t >= window) {
+      points.pop_front();
+    }
+  }
+
+  double slope() const {
+    const size_t n = points.size();
+    if (n < 2) {
+      return 0.0;
+    }
+    double mean_t = 0.0;
+    double mean_y = 0.0;
+    for (const point& p : points) {
+      mean_t += p.t;
+      mean_y += p.y;
+    }
+    mean_t /= n;
+    mean_y /= n;
+    double sum_ty = 0.0;
+    double sum_tt = 0.0;
+    for (const point& p : points) {
+      sum_ty += (p.t - mean_t) * (p.y - mean_y);
+      sum_tt += (p.t - mean_t) * (p.t - mean_t);
+    }
+    return sum_tt > 0.0 ? sum_ty / sum_tt : 0.0;
+  }
+
+  bool settled() const {
+    return points.size() >= 3 &&
+           points.back().t - points.front().t >= window &&
+           std::fabs(slope()) <= threshold;
+  }
+
+ private:
+  struct point {
+    double t;
+    double y;
+  };
+  double window;
+  double threshold;
+  std::deque<point> points;
+};
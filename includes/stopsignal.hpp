@@ -0,0 +1,35 @@
+﻿#pragma once
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+// Stop request shared between the UI and a running sweep. A sweep sleeping
+// in the executor wakes as soon as stop is requested and the executor woken,
+// instead of finishing its step.
+class stopsignal {
+ public:
+  typedef std::chrono::steady_clock clock;
+
+  void reset() {
+    std::lock_guard<std::mutex> lock(mtx);
+    stopped = false;
+  }
+
+  void request() {
+    std::lock_guard<std::mutex> lock(mtx);
+    requested_at = clock::now();
+    stopped = true;
+  }
+
+  bool requested() const { return stopped; }
+
+  clock::time_point requestedAt() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return requested_at;
+  }
+
+ private:
+  std::mutex mtx;
+  std::atomic<bool> stopped{false};
+  clock::time_point requested_at;
+};
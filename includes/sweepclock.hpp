@@ -0,0 +1,52 @@
+﻿#pragma once
+#include <chrono>
+
+// Plans a sweep against absolute deadlines on the steady clock. Every
+// operation is a round trip; it is started early by half its measured
+// latency so that its midpoint, when the instrument acts on it, lands on the
+// planned time. Late operations do not shift the plan.
+class sweepclock {
+ public:
+  typedef std::chrono::steady_clock clock;
+
+  // Smoothed round-trip time of one kind of operation, in seconds.
+  struct latency {
+    double estimate = 0.0;
+    void update(double seconds) {
+      estimate = estimate == 0.0 ? seconds : 0.8 * estimate + 0.2 * seconds;
+    }
+  };
+
+  void start() { t0 = clock::now(); }
+  void start(clock::time_point at) { t0 = at; }
+
+  double elapsed(clock::time_point t) const {
+    return std::chrono::duration<double>(t - t0).count();
+  }
+
+  // A step from `begin` to `end` is measured as late as possible while
+  // still leaving room for the next setpoint to go out on time.
+  double measureAt(double begin, double end, const latency& set,
+                   const latency& read) const {
+    const double planned = end - 0.5 * set.estimate - 0.5 * read.estimate;
+    return planned > begin ? planned : begin;
+  }
+
+  // When to issue an operation so that its midpoint lands on `planned`
+  // seconds after start().
+  clock::time_point issueAt(double planned, const latency& l) const {
+    return t0 + std::chrono::duration_cast<clock::duration>(
+                    std::chrono::duration<double>(planned - 0.5 * l.estimate));
+  }
+
+  // Folds the round trip of an operation into `l` and returns its midpoint
+  // on the sweep clock.
+  double finished(clock::time_point sent, clock::time_point done,
+                  latency& l) const {
+    l.update(std::chrono::duration<double>(done - sent).count());
+    return elapsed(sent + (done - sent) / 2);
+  }
+
+ private:
+  clock::time_point t0;
+};
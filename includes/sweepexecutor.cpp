@@ -0,0 +1,210 @@
+﻿#include "sweepexecutor.hpp"
+
+std::coroutine_handle<> sweeptask::promise_type::final_awaiter::await_suspend(
+    handle h) noexcept {
+  promise_type& p = h.promise();
+  if (p.owner != nullptr) {
+    p.owner->finished(h);
+    return std::noop_coroutine();
+  }
+  return p.continuation ? p.continuation : std::noop_coroutine();
+}
+
+sweepexecutor::sweepexecutor(int blocking_threads) {
+  for (int i = 0; i < (blocking_threads < 1 ? 1 : blocking_threads); i++) {
+    pool.emplace_back(&sweepexecutor::work, this, false);
+  }
+  safety_worker = std::thread(&sweepexecutor::work, this, true);
+  loop = std::thread(&sweepexecutor::run, this);
+}
+
+sweepexecutor::~sweepexecutor() {
+  // Blocking calls finish first: their frames are resumed through post().
+  {
+    std::lock_guard<std::mutex> lock(pool_mtx);
+    pool_running = false;
+  }
+  pool_cv.notify_all();
+  safety_cv.notify_all();
+  for (std::thread& t : pool) {
+    t.join();
+  }
+  safety_worker.join();
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    running = false;
+  }
+  cv.notify_one();
+  loop.join();
+  // Sweeps still waiting at exit are dropped with everything they own.
+  for (void* address : tasks) {
+    std::coroutine_handle<>::from_address(address).destroy();
+  }
+}
+
+void sweepexecutor::spawn(sweeptask task) {
+  sweeptask::handle h = task.h;
+  task.h = nullptr;
+  h.promise().owner = this;
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    active++;
+  }
+  post([this, h]() {
+    tasks.insert(h.address());
+    h.resume();
+  });
+}
+
+void sweepexecutor::finished(sweeptask::handle h) {
+  tasks.erase(h.address());
+  h.destroy();
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    active--;
+  }
+  idle.notify_all();
+}
+
+void sweepexecutor::drain() {
+  std::unique_lock<std::mutex> lock(mtx);
+  idle.wait(lock, [this]() { return active == 0; });
+}
+
+void sweepexecutor::post(std::function<void()> fn) {
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    posted.push_back(std::move(fn));
+  }
+  cv.notify_one();
+}
+
+void sweepexecutor::wake() {
+  post([]() {});
+}
+
+bool sweepexecutor::sleeper::await_ready() {
+  if (stop != nullptr && stop->requested()) {
+    stopped = true;
+    return true;
+  }
+  return deadline <= clock::now();
+}
+
+void sweepexecutor::sleeper::await_suspend(std::coroutine_handle<> h) {
+  std::lock_guard<std::mutex> lock(exec->mtx);
+  exec->timers.emplace(deadline, timer{stop, &stopped, h});
+}
+
+void sweepexecutor::command::await_suspend(std::coroutine_handle<> h) {
+  queue->submit(frame, priority, [this, h](const it8512codec::reply& r) {
+    reply = r;
+    exec->post([h]() { h.resume(); });
+  });
+}
+
+sweepexecutor::pending sweepexecutor::send(it8512queue* queue,
+                                           const it8512codec::frame& frame,
+                                           it8512queue::lane priority) {
+  pending p{this, std::make_shared<pending::state>()};
+  std::shared_ptr<pending::state> s = p.s;
+  queue->submit(frame, priority, [this, s](const it8512codec::reply& r) {
+    std::coroutine_handle<> waiter;
+    {
+      std::lock_guard<std::mutex> lock(s->mtx);
+      s->reply = r;
+      s->received = clock::now();
+      s->done = true;
+      waiter = s->waiter;
+    }
+    if (waiter) {
+      post([waiter]() { waiter.resume(); });
+    }
+  });
+  return p;
+}
+
+bool sweepexecutor::pending::await_ready() const {
+  std::lock_guard<std::mutex> lock(s->mtx);
+  return s->done;
+}
+
+bool sweepexecutor::pending::await_suspend(std::coroutine_handle<> h) {
+  std::lock_guard<std::mutex> lock(s->mtx);
+  if (s->done) {
+    return false;
+  }
+  s->waiter = h;
+  return true;
+}
+
+void sweepexecutor::blocking::await_suspend(std::coroutine_handle<> h) {
+  {
+    std::lock_guard<std::mutex> lock(exec->pool_mtx);
+    (safety ? exec->safety_jobs : exec->jobs).push_back([this, h]() {
+      result = fn();
+      exec->post([h]() { h.resume(); });
+    });
+  }
+  (safety ? exec->safety_cv : exec->pool_cv).notify_one();
+}
+
+void sweepexecutor::run() {
+  std::vector<std::function<void()>> ready;
+  std::vector<std::coroutine_handle<>> due;
+  std::unique_lock<std::mutex> lock(mtx);
+  while (running) {
+    ready.swap(posted);
+    const clock::time_point now = clock::now();
+    for (auto it = timers.begin(); it != timers.end();) {
+      if (it->first <= now) {
+        due.push_back(it->second.h);
+        it = timers.erase(it);
+      } else if (it->second.stop != nullptr &&
+                 it->second.stop->requested()) {
+        *it->second.stopped = true;
+        due.push_back(it->second.h);
+        it = timers.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    if (ready.empty() && due.empty()) {
+      if (timers.empty()) {
+        cv.wait(lock);
+      } else {
+        cv.wait_until(lock, timers.begin()->first);
+      }
+      continue;
+    }
+    lock.unlock();
+    for (std::coroutine_handle<>& h : due) {
+      h.resume();
+    }
+    for (std::function<void()>& fn : ready) {
+      fn();
+    }
+    due.clear();
+    ready.clear();
+    lock.lock();
+  }
+}
+
+void sweepexecutor::work(bool safety) {
+  std::deque<std::function<void()>>& queue = safety ? safety_jobs : jobs;
+  std::condition_variable& ready = safety ? safety_cv : pool_cv;
+  while (true) {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(pool_mtx);
+      ready.wait(lock,
+                 [this, &queue]() { return !pool_running || !queue.empty(); });
+      if (queue.empty()) {
+        return;
+      }
+      job = std::move(queue.front());
+      queue.pop_front();
+    }
+    job();
+  }
+}
@@ -0,0 +1,192 @@
+﻿#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "it8512queue.hpp"
+#include "stopsignal.hpp"
+
+class sweepexecutor;
+
+// A sweep or one of its parts written as a coroutine. It starts when it is
+// awaited (or spawned) and yields true on success, like the blocking
+// functions it replaces; awaiting it resumes the awaiter directly when it
+// finishes.
+class sweeptask {
+ public:
+  struct promise_type;
+  typedef std::coroutine_handle<promise_type> handle;
+
+  struct promise_type {
+    bool result = false;
+    std::coroutine_handle<> continuation;
+    sweepexecutor* owner = nullptr;  // set once spawned
+
+    sweeptask get_return_object() {
+      return sweeptask(handle::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    struct final_awaiter {
+      bool await_ready() noexcept { return false; }
+      std::coroutine_handle<> await_suspend(handle h) noexcept;
+      void await_resume() noexcept {}
+    };
+    final_awaiter final_suspend() noexcept { return {}; }
+    void return_value(bool value) { result = value; }
+    void unhandled_exception() { std::terminate(); }
+  };
+
+  sweeptask(sweeptask&& other) noexcept : h(other.h) { other.h = nullptr; }
+  sweeptask(const sweeptask&) = delete;
+  sweeptask& operator=(const sweeptask&) = delete;
+  ~sweeptask() {
+    if (h) {
+      h.destroy();
+    }
+  }
+
+  bool await_ready() const noexcept { return false; }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) {
+    h.promise().continuation = awaiter;
+    return h;
+  }
+  bool await_resume() const { return h.promise().result; }
+
+ private:
+  friend class sweepexecutor;
+  explicit sweeptask(handle h) : h(h) {}
+  handle h;
+};
+
+// Runs any number of sweeps as coroutines on one thread. A sweep waiting
+// for its next deadline or for an instrument reply holds no thread, only
+// its coroutine frame, so one loop drives every station. Waits on a stop
+// signal end as soon as wake() is called after the stop is requested, and
+// the sweep unwinds through its own code instead of a thread being torn
+// down. Calls that can only block (VISA, the list uploads) run on a small
+// pool and resume the sweep on the loop when they return; safety calls get a
+// thread of their own that nothing else can occupy.
+class sweepexecutor {
+ public:
+  typedef std::chrono::steady_clock clock;
+
+  explicit sweepexecutor(int blocking_threads = 4);
+  ~sweepexecutor();
+  // Starts `task` on the loop; its frame is freed when it finishes.
+  void spawn(sweeptask task);
+  // Runs `fn` on the loop thread.
+  void post(std::function<void()> fn);
+  // Re-checks every wait for a requested stop.
+  void wake();
+  // Blocks until every spawned task has finished. Request their stops and
+  // wake() first; a task that is never stopped is waited for forever.
+  void drain();
+
+  struct sleeper {
+    sweepexecutor* exec;
+    clock::time_point deadline;
+    stopsignal* stop;
+    bool stopped = false;
+    bool await_ready();
+    void await_suspend(std::coroutine_handle<> h);
+    bool await_resume() const { return !stopped; }
+  };
+  // co_await: sleeps until `deadline`; false if `stop` was requested first.
+  sleeper sleepUntil(clock::time_point deadline, stopsignal* stop) {
+    return sleeper{this, deadline, stop};
+  }
+
+  struct command {
+    sweepexecutor* exec;
+    it8512queue* queue;
+    it8512codec::frame frame;
+    it8512queue::lane priority;
+    it8512codec::reply reply = {};
+    bool await_ready() const { return false; }
+    void await_suspend(std::coroutine_handle<> h);
+    it8512codec::reply await_resume() const { return reply; }
+  };
+  // co_await: the reply to `frame` sent through the load's queue.
+  command submit(it8512queue* queue, const it8512codec::frame& frame,
+                 it8512queue::lane priority = it8512queue::SWEEP) {
+    return command{this, queue, frame, priority};
+  }
+
+  struct pending {
+    struct state {
+      std::mutex mtx;
+      bool done = false;
+      it8512codec::reply reply = {};
+      clock::time_point received;
+      std::coroutine_handle<> waiter;
+    };
+    sweepexecutor* exec;
+    std::shared_ptr<state> s;
+    bool await_ready() const;
+    bool await_suspend(std::coroutine_handle<> h);
+    it8512codec::reply await_resume() const { return s->reply; }
+    // When the reply came in; valid once awaited.
+    clock::time_point received() const { return s->received; }
+  };
+  // Sends `frame` through the load's queue right away, so the sweep can do
+  // something else meanwhile; co_await the result for the reply.
+  pending send(it8512queue* queue, const it8512codec::frame& frame,
+               it8512queue::lane priority = it8512queue::SWEEP);
+
+  struct blocking {
+    sweepexecutor* exec;
+    std::function<bool()> fn;
+    bool safety;
+    bool result = false;
+    bool await_ready() const { return false; }
+    void await_suspend(std::coroutine_handle<> h);
+    bool await_resume() const { return result; }
+  };
+  // co_await: the result of the blocking call `fn`, run off the loop.
+  blocking offload(std::function<bool()> fn) {
+    return blocking{this, std::move(fn), false};
+  }
+  // co_await: as offload, but on the safety thread, so turning an output
+  // off never waits behind pool calls blocked on a slow instrument.
+  blocking offloadSafety(std::function<bool()> fn) {
+    return blocking{this, std::move(fn), true};
+  }
+
+ private:
+  friend struct sweeptask::promise_type::final_awaiter;
+  struct timer {
+    stopsignal* stop;
+    bool* stopped;
+    std::coroutine_handle<> h;
+  };
+  void run();
+  void work(bool safety);
+  void finished(sweeptask::handle h);
+  std::mutex mtx;
+  std::condition_variable cv;
+  bool running = true;
+  std::vector<std::function<void()>> posted;
+  std::multimap<clock::time_point, timer> timers;
+  std::set<void*> tasks;  // spawned frames, touched on the loop only
+  size_t active = 0;      // spawned and not yet finished, under mtx
+  std::condition_variable idle;
+  std::thread loop;
+
+  std::mutex pool_mtx;
+  std::condition_variable pool_cv;
+  bool pool_running = true;
+  std::deque<std::function<void()>> jobs;
+  std::vector<std::thread> pool;
+  std::condition_variable safety_cv;
+  std::deque<std::function<void()>> safety_jobs;
+  std::thread safety_worker;
+};
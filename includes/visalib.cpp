@@ -1,58 +1,86 @@
 ﻿#include "visalib.hpp"
 
-visalib::visalib(char* deviceName) {
-  if (viOpenDefaultRM(&defaultRM) < VI_SUCCESS) {
-    std::cout << "Could not open a session to the VISA Resource Manager!"
-              << std::endl;
-    return;
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+visalib::visalib(char* deviceName) : link(scpitransport::open(deviceName)) {}
+
+visalib::~visalib() { delete link; }
+
+visalib::hold::hold(visalib* owner, bool urgent) : owner(owner) {
+  std::unique_lock<std::mutex> lock(owner->bus);
+  if (urgent) {
+    owner->urgent_waiting++;
+  }
+  owner->bus_free.wait(lock, [owner, urgent]() {
+    return !owner->bus_busy && (urgent || owner->urgent_waiting == 0);
+  });
+  if (urgent) {
+    owner->urgent_waiting--;
   }
+  owner->bus_busy = true;
+}
 
-  if (viOpen(defaultRM, deviceName, VI_NO_LOCK, 0, &instr) < VI_SUCCESS) {
-    std::cout << "Cannot open a session to the device.<< std::endl"
-              << std::endl;
-    return;
+visalib::hold::~hold() {
+  {
+    std::lock_guard<std::mutex> lock(owner->bus);
+    owner->bus_busy = false;
   }
+  owner->bus_free.notify_all();
+}
 
-  viSetAttribute(instr, VI_ATTR_TMO_VALUE, 5000);
-  viSetAttribute(instr, VI_ATTR_ASRL_BAUD, 115200);
-  viSetAttribute(instr, VI_ATTR_ASRL_DATA_BITS, 8);
-  viSetAttribute(instr, VI_ATTR_ASRL_PARITY, VI_ASRL_PAR_NONE);
-  viSetAttribute(instr, VI_ATTR_ASRL_STOP_BITS, VI_ASRL_STOP_ONE);
-  viSetAttribute(instr, VI_ATTR_TERMCHAR_EN, VI_TRUE);
-  viSetAttribute(instr, VI_ATTR_TERMCHAR, 0xA);
+bool visalib::send(const char* command) {
+  if (link == nullptr) {
+    return false;
+  }
+  return link->write(command, (unsigned int)strlen(command));
 }
 
-visalib::~visalib() {
-  viClose(instr);
-  viClose(defaultRM);
+bool visalib::query(const char* command, char* result,
+                    unsigned int maxLength) {
+  if (!send(command)) {
+    return false;
+  }
+  return link->readLine(result, maxLength) >= 0;
 }
 
 bool visalib::output(bool on) {
-  ViUInt32 count;
-  if (on) {
-    viWrite(instr, (ViBuf) "OUTP:TRIG 1\n", 12, &count);
-  } else {
-    viWrite(instr, (ViBuf) "OUTP:TRIG 0\n", 12, &count);
-  }
-  if (count != 12) {
-    std::cout << "电源输出设置失败!" << count << std::endl;
+  return armOutput(on) && fireOutput();
+}
+
+bool visalib::armOutput(bool on) {
+  hold lock(this);
+  if (!send(on ? "OUTP:TRIG 1\n" : "OUTP:TRIG 0\n")) {
+    std::cout << "电源输出设置失败!" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool visalib::fireOutput() {
+  hold lock(this);
+  if (!send("INIT:NAME OUTP\n")) {
+    std::cout << "电源输出设置失败!" << std::endl;
     return false;
   }
-  viWrite(instr, (ViBuf) "INIT:NAME OUTP\n", 15, &count);
-  if (count != 15) {
-    std::cout << "电源输出设置失败!" << count << std::endl;
+  return true;
+}
+
+bool visalib::outputOff() {
+  hold lock(this, true);
+  if (!send("OUTP:TRIG 0\n") || !send("INIT:NAME OUTP\n")) {
+    std::cout << "电源输出设置失败!" << std::endl;
     return false;
   }
   return true;
 }
 
 bool visalib::setVoltage(float voltage) {
+  hold lock(this);
   char buf[35];
-  ViUInt32 count;
   sprintf(buf, "SOUR:VOLT:LEV:IMM:AMPL %.3f\n", voltage);
-  ViUInt32 length = (ViUInt32)strlen(buf);
-  viWrite(instr, (ViBuf)buf, length, &count);
-  if (count != length) {
+  if (!send(buf)) {
     std::cout << "设置电源电压失败!" << std::endl;
     return false;
   }
@@ -60,31 +88,125 @@ bool visalib::setVoltage(float voltage) {
 }
 
 float visalib::readVoltage() {
-  ViUInt32 count;
-  viWrite(instr, (ViBuf) "meas:volt:dc?\n", 14, &count);
-  if (count != 14) {
-    std::cout << "读取电源电压失败!" << count << std::endl;
-    return false;
-  }
-  ViChar result[257];
-  if (viRead(instr, (ViPBuf)result, 256, &count) < VI_SUCCESS) {
-    std::cout << "读取电源电压失败!" << count << std::endl;
+  hold lock(this);
+  char result[257];
+  if (!query("meas:volt:dc?\n", result, sizeof(result))) {
+    std::cout << "读取电源电压失败!" << std::endl;
     return 0.0f;
   }
   return atof(result);
 }
 
 float visalib::readCurrent() {
-  ViUInt32 count;
-  viWrite(instr, (ViBuf) "meas:curr:dc?\n", 14, &count);
-  if (count != 14) {
-    std::cout << "读取电源电流失败!" << count << std::endl;
-    return false;
-  }
-  ViChar result[257];
-  if (viRead(instr, (ViPBuf)result, 256, &count) < VI_SUCCESS) {
-    std::cout << "读取电源电流失败!" << count << std::endl;
+  hold lock(this);
+  char result[257];
+  if (!query("meas:curr:dc?\n", result, sizeof(result))) {
+    std::cout << "读取电源电流失败!" << std::endl;
     return 0.0f;
   }
   return atof(result);
-}
\ No newline at end of file
+}
+
+// Voltage and current in one compound query, so a sample costs a single
+// round trip to the supply instead of two.
+bool visalib::measure(measurement& m) {
+  hold lock(this);
+  char result[257];
+  const std::chrono::steady_clock::time_point sent =
+      std::chrono::steady_clock::now();
+  if (!query("MEAS:VOLT:DC?;:MEAS:CURR:DC?\n", result, sizeof(result))) {
+    std::cout << "读取电源电压、电流失败!" << std::endl;
+    return false;
+  }
+  const std::chrono::steady_clock::time_point received =
+      std::chrono::steady_clock::now();
+  char* end;
+  const double voltage = strtod(result, &end);
+  if (end == result || *end != ';') {
+    std::cout << "电源应答无效!" << std::endl;
+    return false;
+  }
+  const char* rest = end + 1;
+  const double current = strtod(rest, &end);
+  if (end == rest) {
+    std::cout << "电源应答无效!" << std::endl;
+    return false;
+  }
+  m.time = sent + (received - sent) / 2;
+  m.voltage = (float)voltage;
+  m.current = (float)current;
+  m.power = m.voltage * m.current;
+  std::lock_guard<std::mutex> cache_lock(cache_mutex);
+  last = m;
+  has_last = true;
+  return true;
+}
+
+// Does not touch the bus, so a poller never queues behind a sweep's query
+// just to repeat it.
+bool visalib::recent(double max_age, measurement& m) {
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  if (!has_last || std::chrono::steady_clock::now() - last.time >
+                       std::chrono::duration<double>(max_age)) {
+    return false;
+  }
+  m = last;
+  return true;
+}
+
+bool visalib::uploadList(const float* voltages, const float* seconds,
+                         int count) {
+  hold lock(this);
+  std::string volt = "LIST:VOLT ";
+  std::string dwell = "LIST:DWEL ";
+  char buf[32];
+  for (int i = 0; i < count; i++) {
+    sprintf(buf, i == 0 ? "%.3f" : ",%.3f", voltages[i]);
+    volt += buf;
+    sprintf(buf, i == 0 ? "%.4f" : ",%.4f", seconds[i]);
+    dwell += buf;
+  }
+  volt += "\n";
+  dwell += "\n";
+  const char* setup[] = {
+      "*CLS\n",
+      volt.c_str(),
+      dwell.c_str(),
+      "LIST:COUN 1\n",
+      "VOLT:MODE LIST\n",
+      "TRIG:SOUR BUS\n",
+      "INIT\n",
+  };
+  for (const char* command : setup) {
+    if (!send(command)) {
+      std::cout << "上传电源列表失败!" << std::endl;
+      return false;
+    }
+  }
+  char result[257];
+  if (!query("SYST:ERR?\n", result, sizeof(result))) {
+    std::cout << "上传电源列表失败!" << std::endl;
+    return false;
+  }
+  if (atoi(result) != 0) {
+    std::cout << "电源不支持列表模式: " << result << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// *OPC? makes the trigger acknowledged, so its round trip can be timed.
+bool visalib::trigger() {
+  hold lock(this);
+  char result[257];
+  if (!query("*TRG;*OPC?\n", result, sizeof(result))) {
+    std::cout << "触发电源列表失败!" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool visalib::stopList() {
+  hold lock(this);
+  return send("ABOR\n") && send("VOLT:MODE FIX\n");
+}
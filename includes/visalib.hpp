@@ -1,17 +1,64 @@
 ﻿#pragma once
+#include <chrono>
+#include <condition_variable>
 #include <iostream>
+#include <mutex>
+#include <string>
+
+#include "scpitransport.hpp"
+
+// One supply reading. `time` is the middle of the query's round trip.
+struct measurement {
+  std::chrono::steady_clock::time_point time;
+  float voltage;
+  float current;
+  float power;
+};
 
-#include "visa.h"
 class visalib {
  public:
   visalib(char* deviceName);
   ~visalib();
   bool output(bool on);
+  // output() in two parts, so a mode switch can select the state ahead of
+  // time and change the output with a single write when it is due.
+  bool armOutput(bool on);
+  bool fireOutput();
+  // Turns the output off ahead of every caller still waiting for the bus;
+  // only a command already on the wire is waited for.
+  bool outputOff();
   float readVoltage();
   float readCurrent();
+  bool measure(measurement& m);
+  // Latest successful measure() if it is at most `max_age` seconds old.
+  bool recent(double max_age, measurement& m);
+  // SCPI list: the supply steps through the voltages on its own clock once
+  // triggered. Fails if the supply reports an error, e.g. when it has no
+  // LIST subsystem.
+  bool uploadList(const float* voltages, const float* seconds, int count);
+  bool trigger();
+  bool stopList();
   bool setVoltage(float voltage);
 
  private:
-  ViSession defaultRM;
-  ViSession instr;
-};
\ No newline at end of file
+  bool send(const char* command);
+  bool query(const char* command, char* result, unsigned int maxLength);
+  // Holds the bus for one command or query. Urgent holders are let in
+  // before anyone else who is waiting.
+  class hold {
+   public:
+    explicit hold(visalib* owner, bool urgent = false);
+    ~hold();
+
+   private:
+    visalib* owner;
+  };
+  scpitransport* link;
+  std::mutex bus;
+  std::condition_variable bus_free;
+  bool bus_busy = false;
+  int urgent_waiting = 0;
+  std::mutex cache_mutex;
+  measurement last = {};
+  bool has_last = false;
+};
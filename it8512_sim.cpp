@@ -0,0 +1,452 @@
+﻿// IT8512 electronic load simulator. Opens a pseudo-terminal that speaks the
+// 26-byte 0xAA-framed protocol used by seriallib, backed by cellmodel, so the
+// acquisition and sweep paths can be exercised without a load attached.
+//
+//   ./it8512_sim --link /tmp/ttyIT8512 --baud 38400
+//
+// then open /tmp/ttyIT8512 with seriallib. With --baud the simulator delays
+// every reply by the time the request and reply frames would spend on a wire
+// of that speed (full duplex, one frame at a time in each direction).
+// --drop and --corrupt inject line faults into that fraction of replies
+// (one byte removed, or one byte flipped) to exercise resynchronization.
+// CC, CV, CW and CR setpoints and lists are modelled; lists run on the
+// simulator's clock once bus-triggered.
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "cellmodel.hpp"
+#include "it8512codec.hpp"
+
+typedef std::chrono::steady_clock sim_clock;
+
+struct reply {
+  sim_clock::time_point due;
+  unsigned char frame[26];
+};
+
+class it8512sim {
+ public:
+  explicit it8512sim(const cellmodel& model)
+      : cell(model), last_update(sim_clock::now()) {}
+
+  void handle(const unsigned char* in, unsigned char* out) {
+    update();
+    memset(out, 0, 26);
+    out[0] = it8512codec::header;
+    out[1] = in[1];
+    if (!it8512codec::decode(in).valid) {
+      status(out, it8512codec::CHECKSUM_ERROR);
+    } else {
+      dispatch(in, out);
+    }
+    out[25] = sum(out);
+  }
+
+ private:
+  static void put32(unsigned char* p, unsigned int v) {
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = (v >> 24) & 0xFF;
+  }
+
+  static unsigned char sum(const unsigned char* frame) {
+    unsigned int total = 0;
+    for (int i = 0; i < 25; i++) {
+      total += frame[i];
+    }
+    return total % 256;
+  }
+
+  static void status(unsigned char* out, unsigned char code) {
+    out[2] = it8512codec::STATUS;
+    out[3] = code;
+  }
+
+  void dispatch(const unsigned char* in, unsigned char* out) {
+    switch (in[2]) {
+      case it8512codec::REMOTE:
+        remote = in[3] == 1;
+        status(out, it8512codec::OK);
+        break;
+      case it8512codec::LOAD:
+        load_on = in[3] == 1;
+        status(out, it8512codec::OK);
+        break;
+      case it8512codec::MODE:
+        if (in[3] > 3) {
+          status(out, it8512codec::PARAMETER_ERROR);
+          break;
+        }
+        load_type = in[3];
+        status(out, it8512codec::OK);
+        break;
+      case it8512codec::SET_CURRENT:
+        set_current = it8512codec::u32(in + 3) / 10000.0;
+        status(out, it8512codec::OK);
+        break;
+      case it8512codec::SET_VOLTAGE:
+        set_voltage = it8512codec::u32(in + 3) / 1000.0;
+        status(out, it8512codec::OK);
+        break;
+      case it8512codec::SET_POWER:
+        set_power = it8512codec::u32(in + 3) / 1000.0;
+        status(out, it8512codec::OK);
+        break;
+      case it8512codec::SET_RESISTANCE:
+        set_resistance = it8512codec::u32(in + 3) / 1000.0;
+        status(out, it8512codec::OK);
+        break;
+      case it8512codec::LIST_MODE:
+        if (in[3] > 3) {
+          status(out, it8512codec::PARAMETER_ERROR);
+          break;
+        }
+        list_mode = in[3];
+        status(out, it8512codec::OK);
+        break;
+      case it8512codec::LIST_REPEAT:
+        list_repeat = in[3] == 1;
+        status(out, it8512codec::OK);
+        break;
+      case it8512codec::LIST_STEPS:
+        list.assign(it8512codec::u16(in + 3), step{0.0, 0.0});
+        list_running = false;
+        list_started = false;
+        status(out, it8512codec::OK);
+        break;
+      case it8512codec::LIST_CURRENT:
+      case it8512codec::LIST_VOLTAGE:
+      case it8512codec::LIST_POWER:
+      case it8512codec::LIST_RESISTANCE: {
+        const unsigned int n = it8512codec::u16(in + 3);
+        if (n >= list.size()) {
+          status(out, it8512codec::PARAMETER_ERROR);
+          break;
+        }
+        list[n].value = it8512codec::u32(in + 5) /
+                        (in[2] == it8512codec::LIST_CURRENT ? 10000.0 : 1000.0);
+        list[n].seconds = it8512codec::u16(in + 9) / 10000.0;
+        status(out, it8512codec::OK);
+        break;
+      }
+      case it8512codec::TRIGGER_SOURCE:
+        if (in[3] > 2) {
+          status(out, it8512codec::PARAMETER_ERROR);
+          break;
+        }
+        trigger_source = in[3];
+        status(out, it8512codec::OK);
+        break;
+      case it8512codec::FUNCTION:
+        if (in[3] != it8512codec::FIXED && in[3] != it8512codec::LIST) {
+          status(out, it8512codec::PARAMETER_ERROR);
+          break;
+        }
+        function = in[3];
+        list_running = false;
+        list_started = false;
+        status(out, it8512codec::OK);
+        break;
+      case it8512codec::TRIGGER:
+        if (function != it8512codec::LIST || list.empty() ||
+            trigger_source != it8512codec::TRIGGER_BUS) {
+          status(out, it8512codec::INVALID_COMMAND);
+          break;
+        }
+        list_running = true;
+        list_started = true;
+        list_index = 0;
+        list_elapsed = 0.0;
+        status(out, it8512codec::OK);
+        break;
+      case it8512codec::READ_VCP: {
+        out[2] = it8512codec::READ_VCP;
+        const double v = voltage > 0.0 ? voltage : 0.0;
+        const double i = current > 0.0 ? current : 0.0;
+        put32(out + 3, (unsigned int)(v * 1000.0 + 0.5));
+        put32(out + 7, (unsigned int)(i * 10000.0 + 0.5));
+        put32(out + 11, (unsigned int)(v * i * 1000.0 + 0.5));
+        // Operation state register: bit 3 = output on, bit 0 = remote.
+        out[15] = (load_on ? 0x08 : 0x00) | (remote ? 0x01 : 0x00);
+        break;
+      }
+      default:
+        status(out, it8512codec::UNKNOWN_COMMAND);
+        break;
+    }
+  }
+
+  // Advances the model to the present. A running list changes setpoint at
+  // its step boundaries, so each piece is run with the setpoint active then;
+  // a finished list holds its last step.
+  void update() {
+    const sim_clock::time_point t = sim_clock::now();
+    double dt = std::chrono::duration<double>(t - last_update).count();
+    last_update = t;
+    while (list_running && dt > 0.0) {
+      const step& s = list[list_index];
+      const double length = s.seconds > 0.0001 ? s.seconds : 0.0001;
+      const double piece =
+          length - list_elapsed < dt ? length - list_elapsed : dt;
+      run(list_mode, s.value, piece);
+      dt -= piece;
+      list_elapsed += piece;
+      if (list_elapsed >= length) {
+        list_elapsed = 0.0;
+        if (list_index + 1 < list.size()) {
+          list_index++;
+        } else if (list_repeat) {
+          list_index = 0;
+        } else {
+          list_running = false;
+        }
+      }
+    }
+    if (dt <= 0.0) {
+      return;
+    }
+    if (function == it8512codec::LIST && list_started) {
+      run(list_mode, list[list_index].value, dt);
+    } else {
+      run(load_type, setpoint(), dt);
+    }
+  }
+
+  // Fixed-mode setpoint for the selected load type.
+  double setpoint() const {
+    switch (load_type) {
+      case it8512codec::CV:
+        return set_voltage;
+      case it8512codec::CW:
+        return set_power;
+      case it8512codec::CR:
+        return set_resistance;
+      default:
+        return set_current;
+    }
+  }
+
+  void run(int type, double setpoint, double dt) {
+    if (!load_on) {
+      voltage = cell.drawCurrent(0.0, dt);
+      current = 0.0;
+    } else if (type == it8512codec::CV) {
+      // CV: the load sinks whatever current pulls the stack down to the
+      // setpoint, and nothing when the setpoint is above open circuit.
+      const double ocv = cell.parameters().steadyVoltage(0.0);
+      if (setpoint >= ocv) {
+        voltage = cell.drawCurrent(0.0, dt);
+        current = 0.0;
+      } else {
+        current = cell.holdVoltage(setpoint, dt);
+        voltage = cell.read();
+      }
+    } else if (type == it8512codec::CW || type == it8512codec::CR) {
+      // CW: the load draws the current at which the stack delivers the set
+      // power. CR: the current at which the stack voltage is that current
+      // times the set resistance.
+      const cellmodel& model = cell.parameters();
+      current = type == it8512codec::CW
+                    ? (setpoint > 0.0 ? model.currentAtPower(setpoint) : 0.0)
+                    : model.currentAtResistance(setpoint);
+      voltage = cell.drawCurrent(current, dt);
+    } else {
+      current = setpoint;
+      voltage = cell.drawCurrent(setpoint, dt);
+    }
+  }
+
+  struct step {
+    double value;
+    double seconds;
+  };
+
+  cellstate cell;
+  sim_clock::time_point last_update;
+  bool remote = false;
+  bool load_on = false;
+  int load_type = 0;
+  double set_current = 0.0;
+  double set_voltage = 0.0;
+  double set_power = 0.0;
+  double set_resistance = 0.0;
+  double voltage = 0.0;
+  double current = 0.0;
+  int function = it8512codec::FIXED;
+  int trigger_source = it8512codec::TRIGGER_MANUAL;
+  int list_mode = it8512codec::CC;
+  bool list_repeat = false;
+  std::vector<step> list;
+  bool list_running = false;
+  bool list_started = false;
+  size_t list_index = 0;
+  double list_elapsed = 0.0;
+};
+
+static void usage() {
+  printf(
+      "usage: it8512_sim [--link PATH] [--baud N] [--latency-ms MS]\n"
+      "                  [--drop P] [--corrupt P]\n"
+      "                  [--cells N] [--e0 V] [--tafel V] [--i0 A] [--r OHM]\n"
+      "                  [--b V] [--il A] [--tau S] [--noise V]\n");
+}
+
+int main(int argc, char** argv) {
+  cellmodel model;
+  std::string link;
+  double baud = 0.0;
+  double latency_ms = 0.0;
+  double drop = 0.0;
+  double corrupt = 0.0;
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+    if (value == NULL) {
+      usage();
+      return 1;
+    }
+    if (!strcmp(arg, "--link")) {
+      link = value;
+    } else if (!strcmp(arg, "--baud")) {
+      baud = atof(value);
+    } else if (!strcmp(arg, "--latency-ms")) {
+      latency_ms = atof(value);
+    } else if (!strcmp(arg, "--drop")) {
+      drop = atof(value);
+    } else if (!strcmp(arg, "--corrupt")) {
+      corrupt = atof(value);
+    } else if (!strcmp(arg, "--cells")) {
+      model.cells = atoi(value);
+    } else if (!strcmp(arg, "--e0")) {
+      model.e0 = atof(value);
+    } else if (!strcmp(arg, "--tafel")) {
+      model.tafel = atof(value);
+    } else if (!strcmp(arg, "--i0")) {
+      model.i0 = atof(value);
+    } else if (!strcmp(arg, "--r")) {
+      model.r = atof(value);
+    } else if (!strcmp(arg, "--b")) {
+      model.b = atof(value);
+    } else if (!strcmp(arg, "--il")) {
+      model.il = atof(value);
+    } else if (!strcmp(arg, "--tau")) {
+      model.tau = atof(value);
+    } else if (!strcmp(arg, "--noise")) {
+      model.noise = atof(value);
+    } else {
+      usage();
+      return 1;
+    }
+    i++;
+  }
+
+  const int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+    perror("posix_openpt");
+    return 1;
+  }
+  const char* slave = ptsname(master);
+  // Keep the slave open ourselves so the pty survives clients reconnecting,
+  // and put it in raw mode so no byte of a frame gets translated.
+  const int slave_fd = open(slave, O_RDWR | O_NOCTTY);
+  termios tty;
+  tcgetattr(slave_fd, &tty);
+  cfmakeraw(&tty);
+  tcsetattr(slave_fd, TCSANOW, &tty);
+  if (!link.empty()) {
+    unlink(link.c_str());
+    if (symlink(slave, link.c_str()) != 0) {
+      perror("symlink");
+      return 1;
+    }
+  }
+  printf("IT8512 simulator on %s%s%s\n", slave, link.empty() ? "" : " -> ",
+         link.c_str());
+  fflush(stdout);
+
+  const auto frame_time = std::chrono::duration_cast<sim_clock::duration>(
+      std::chrono::duration<double>(baud > 0.0 ? 26 * 10 / baud : 0.0));
+  const auto processing = std::chrono::duration_cast<sim_clock::duration>(
+      std::chrono::duration<double, std::milli>(latency_ms));
+  it8512sim sim(model);
+  std::mt19937 rng(std::random_device{}());
+  std::uniform_real_distribution<double> chance(0.0, 1.0);
+  std::uniform_int_distribution<int> position(0, 25);
+  std::deque<reply> replies;
+  unsigned char rx[512];
+  size_t rx_len = 0;
+  sim_clock::time_point rx_free = sim_clock::now();
+  sim_clock::time_point tx_free = rx_free;
+  while (true) {
+    timespec timeout = {0, 0};
+    timespec* wait = NULL;
+    if (!replies.empty()) {
+      const long long ns =
+          std::chrono::duration_cast<std::chrono::nanoseconds>(
+              replies.front().due - sim_clock::now())
+              .count();
+      if (ns > 0) {
+        timeout.tv_sec = ns / 1000000000;
+        timeout.tv_nsec = ns % 1000000000;
+      }
+      wait = &timeout;
+    }
+    pollfd pfd = {master, POLLIN, 0};
+    if (ppoll(&pfd, 1, wait, NULL) > 0 && (pfd.revents & POLLIN)) {
+      const ssize_t n = read(master, rx + rx_len, sizeof(rx) - rx_len);
+      if (n > 0) {
+        rx_len += n;
+      }
+    }
+    // Frames are aligned on the 0xAA header; anything else is line noise.
+    size_t pos = 0;
+    while (rx_len - pos >= 26) {
+      if (rx[pos] != it8512codec::header) {
+        pos++;
+        continue;
+      }
+      const sim_clock::time_point t = sim_clock::now();
+      reply r;
+      sim.handle(rx + pos, r.frame);
+      pos += 26;
+      rx_free = (rx_free > t ? rx_free : t) + frame_time;
+      const sim_clock::time_point ready = rx_free + processing;
+      r.due = (ready > tx_free ? ready : tx_free) + frame_time;
+      tx_free = r.due;
+      replies.push_back(r);
+    }
+    memmove(rx, rx + pos, rx_len - pos);
+    rx_len -= pos;
+    while (!replies.empty() && replies.front().due <= sim_clock::now()) {
+      unsigned char* f = replies.front().frame;
+      size_t n = 26;
+      if (chance(rng) < corrupt) {
+        f[position(rng)] ^= 0x5A;
+      }
+      if (chance(rng) < drop) {
+        const int at = position(rng);
+        memmove(f + at, f + at + 1, 25 - at);
+        n = 25;
+      }
+      if (write(master, f, n) != (ssize_t)n) {
+        perror("write");
+      }
+      replies.pop_front();
+    }
+  }
+}
@@ -0,0 +1,220 @@
+﻿// Sample-log benchmark. Feeds synthetic samples for several stations from
+// one thread, as the UI does, through three paths and prints samples/s and
+// the latency of each per-sample call:
+//
+//   fprintf   the per-sample fprintf on the session CSV plus fopen, fprintf
+//             and fclose of the sweep's _t file, as main.cpp did before the
+//             log writer
+//   buffered  samplelog with stdio writes
+//   uring     samplelog with io_uring writes (buffered where unavailable)
+//
+//   ./logbench [--stations 4] [--seconds 5] [--rate 0] [--csv]
+//              [--dir /tmp/logbench]
+//
+// --rate 0 pushes as fast as the path accepts; otherwise each station gets
+// that many samples per second. --csv makes samplelog write CSV files
+// instead of run files.
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "samplelog.hpp"
+
+namespace {
+typedef std::chrono::steady_clock clock_type;
+
+struct options {
+  int stations = 4;
+  double seconds = 5.0;
+  double rate = 0.0;
+  bool csv = false;
+  std::string dir = "/tmp/logbench";
+};
+
+logrecord sampleAt(long long i, double t) {
+  logrecord r;
+  r.time = t;
+  r.voltage = 1.53f + (i % 97 == 0 ? 0.01f : 0.0f);
+  r.current = 2.995f + (float)(i % 5) * 0.001f;
+  r.power = r.voltage * r.current;
+  r.hydrogen = r.current / 26.801f / 2.0f * 23.8f * 20.0f;
+  r.mode = 0;
+  r.temperature = 700.0f;
+  r.fuel_flow = 0.0f;
+  r.air_flow = 20.0f;
+  r.load_type = 0;
+  return r;
+}
+
+double percentile(std::vector<float>& v, double p) {
+  if (v.empty()) {
+    return 0.0;
+  }
+  const size_t k = (size_t)(p * (v.size() - 1));
+  std::nth_element(v.begin(), v.begin() + k, v.end());
+  return v[k];
+}
+
+void report(const char* name, long long samples, double seconds,
+            std::vector<float>& latency, double writer_max_ms) {
+  const double p50 = percentile(latency, 0.50);
+  const double p99 = percentile(latency, 0.99);
+  const double p999 = percentile(latency, 0.999);
+  const double max = latency.empty()
+                         ? 0.0
+                         : *std::max_element(latency.begin(), latency.end());
+  printf("%-9s %10.0f samples/s  call us p50 %7.2f p99 %8.2f p99.9 %8.2f "
+         "max %9.2f  writer max %.2f ms\n",
+         name, samples / seconds, p50, p99, p999, max, writer_max_ms);
+}
+
+// Calls `one(station, i, t)` for every sample of the run and times each call.
+template <typename F>
+long long feed(const options& o, std::vector<float>& latency, F one) {
+  const clock_type::time_point start = clock_type::now();
+  const clock_type::time_point stop =
+      start + std::chrono::duration_cast<clock_type::duration>(
+                  std::chrono::duration<double>(o.seconds));
+  long long i = 0;
+  for (;;) {
+    clock_type::time_point now = clock_type::now();
+    if (now >= stop) {
+      break;
+    }
+    if (o.rate > 0.0) {
+      const clock_type::time_point due =
+          start + std::chrono::duration_cast<clock_type::duration>(
+                      std::chrono::duration<double>(i / o.rate));
+      if (due > now) {
+        std::this_thread::sleep_until(due);
+      }
+    }
+    const double t = o.rate > 0.0 ? i / o.rate : i * 1e-3;
+    for (int s = 0; s < o.stations; s++) {
+      const clock_type::time_point begin = clock_type::now();
+      one(s, i, t);
+      latency.push_back(std::chrono::duration<float, std::micro>(
+                            clock_type::now() - begin)
+                            .count());
+    }
+    i++;
+  }
+  return i * o.stations;
+}
+
+void benchFprintf(const options& o) {
+  std::vector<FILE*> data;
+  std::vector<std::string> sweeps;
+  for (int s = 0; s < o.stations; s++) {
+    const std::string base = o.dir + "/fprintf" + std::to_string(s);
+    data.push_back(fopen((base + ".csv").c_str(), "w"));
+    sweeps.push_back(base + "_t.csv");
+    remove(sweeps.back().c_str());
+  }
+  std::vector<float> latency;
+  const clock_type::time_point start = clock_type::now();
+  const long long samples =
+      feed(o, latency, [&](int s, long long i, double t) {
+        const logrecord r = sampleAt(i, t);
+        fprintf(data[s], "%.4f,%.2f,%.3f,%.3f,%.3f,%d,%.1f,%.3f,%.3f,%d\n",
+                r.time, r.voltage, r.current, r.power, r.hydrogen, r.mode,
+                r.temperature, r.fuel_flow, r.air_flow, r.load_type);
+        FILE* fp_t = fopen(sweeps[s].c_str(), "a");
+        fprintf(fp_t, "%.4f,%.2f,%.3f,%.3f,%.3f,%d,%.1f,%.3f,%.3f,%d\n",
+                r.time, r.voltage, r.current, r.power, r.hydrogen, r.mode,
+                r.temperature, r.fuel_flow, r.air_flow, r.load_type);
+        fclose(fp_t);
+      });
+  for (FILE* fp : data) {
+    fclose(fp);
+  }
+  report("fprintf", samples,
+         std::chrono::duration<double>(clock_type::now() - start).count(),
+         latency, 0.0);
+}
+
+void benchLogger(const options& o, logstore::backend backend,
+                 const char* name) {
+  logstore::select(backend);
+  std::vector<std::unique_ptr<samplelog>> logs;
+  std::vector<int> data;
+  std::vector<int> sweeps;
+  runheader header = {};
+  for (int s = 0; s < o.stations; s++) {
+    const std::string base =
+        o.dir + "/" + name + std::to_string(s);
+    logs.emplace_back(new samplelog());
+    if (o.csv) {
+      remove((base + ".csv").c_str());
+      remove((base + "_t.csv").c_str());
+      data.push_back(logs[s]->open(base + ".csv", csv_header));
+      sweeps.push_back(logs[s]->open(base + "_t.csv", csv_header));
+    } else {
+      for (int n = 0; std::filesystem::exists(runlog::segmentPath(base, n));
+           n++) {
+        std::filesystem::remove(runlog::segmentPath(base, n));
+      }
+      std::filesystem::remove(runlog::indexPath(base));
+      std::filesystem::remove(base + "_t.run");
+      data.push_back(logs[s]->openSegments(base, header));
+      sweeps.push_back(logs[s]->openRun(base + "_t.run", header));
+    }
+  }
+  std::vector<float> latency;
+  const clock_type::time_point start = clock_type::now();
+  const long long samples =
+      feed(o, latency, [&](int s, long long i, double t) {
+        const logrecord r = sampleAt(i, t);
+        logs[s]->write(data[s], r);
+        logs[s]->write(sweeps[s], r);
+      });
+  double writer_max_ms = 0.0;
+  for (std::unique_ptr<samplelog>& log : logs) {
+    writer_max_ms = (std::max)(writer_max_ms, log->stats().max_write_ms);
+  }
+  // Until everything is on disk.
+  logs.clear();
+  report(name, samples,
+         std::chrono::duration<double>(clock_type::now() - start).count(),
+         latency, writer_max_ms);
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  options o;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--stations") && i + 1 < argc) {
+      o.stations = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--seconds") && i + 1 < argc) {
+      o.seconds = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--rate") && i + 1 < argc) {
+      o.rate = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--csv")) {
+      o.csv = true;
+    } else if (!strcmp(argv[i], "--dir") && i + 1 < argc) {
+      o.dir = argv[++i];
+    } else {
+      printf("usage: %s [--stations N] [--seconds S] [--rate HZ] [--csv] "
+             "[--dir PATH]\n",
+             argv[0]);
+      return 1;
+    }
+  }
+  std::filesystem::create_directories(o.dir);
+  printf("%d stations, %.1f s, %s, %s files\n", o.stations, o.seconds,
+         o.rate > 0.0 ? (std::to_string((int)o.rate) + " Hz").c_str()
+                      : "unthrottled",
+         o.csv ? "CSV" : "run");
+  benchFprintf(o);
+  benchLogger(o, logstore::BUFFERED, "buffered");
+  benchLogger(o, logstore::URING, "uring");
+  return 0;
+}
@@ -24,17 +24,31 @@
 
 #include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <ctime>
+#include <filesystem>
+#include <memory>
 #include <stdexcept>
 #include <thread>
 
+#include "acquisition.hpp"
+#include "checkpoint.hpp"
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_vulkan.h"
 #include "implot.h"
+#include "it8512queue.hpp"
+#include "ivrefine.hpp"
+#include "reactor.hpp"
+#include "recipe.hpp"
 #include "seriallib.hpp"
+#include "station.hpp"
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
+#include "steadystate.hpp"
+#include "stopsignal.hpp"
+#include "sweepclock.hpp"
+#include "sweepexecutor.hpp"
 #include "visalib.hpp"
 #define GLFW_INCLUDE_NONE
 #define GLFW_INCLUDE_VULKAN
@@ -408,196 +422,982 @@ static void glfw_error_callback(int error, const char* description) {
   fprintf(stderr, "Glfw Error %d: %s\n", error, description);
 }
 
-bool turn_on_output(seriallib* it8512, visalib* psw, int mode) {
-  if (mode == 0) {
-    if (!it8512->loadOn()) {
-      std::cout << "打开电子负载失败!" << std::endl;
-      return false;
-    }
-    if (!psw->output(false)) {
-      std::cout << "关闭电源失败!" << std::endl;
-      return false;
-    }
-  } else {
-    if (!it8512->loadOff()) {
-      std::cout << "关闭电子负载失败!" << std::endl;
-      return false;
-    }
-    if (!psw->output(true)) {
-      std::cout << "打开电源失败!" << std::endl;
-      return false;
-    }
+// Edges of one FC/EC changeover: when each instrument was sent its output
+// change and when the change was confirmed (load reply, supply write done).
+struct modeswitch {
+  std::chrono::steady_clock::time_point load_sent;
+  std::chrono::steady_clock::time_point load_done;
+  std::chrono::steady_clock::time_point psw_sent;
+  std::chrono::steady_clock::time_point psw_done;
+};
+
+// The supply is armed before anything changes, so the switch itself is one
+// load frame on the safety lane and one supply write, issued together on the
+// two ports. Both edges are stamped into `edges` if given. Once `stop` is
+// requested nothing more is sent: a supply fired after safe_stop would turn
+// the output back on.
+sweeptask turn_on_output(sweepexecutor* exec, it8512queue* load,
+                         visalib* psw, int mode, modeswitch* edges = nullptr,
+                         stopsignal* stop = nullptr) {
+  auto stopped = [stop]() { return stop != nullptr && stop->requested(); };
+  bool ok = true;
+  if (!co_await exec->offload([&]() {
+        return !stopped() && psw->armOutput(mode == 1);
+      })) {
+    ok = false;
+  }
+  if (stopped()) {
+    co_return false;
+  }
+  modeswitch local;
+  modeswitch& e = edges ? *edges : local;
+  e.load_sent = std::chrono::steady_clock::now();
+  sweepexecutor::pending load_done = exec->send(
+      load,
+      mode == 0 ? it8512codec::fixed<it8512codec::LOAD, 1>::value
+                : it8512codec::fixed<it8512codec::LOAD, 0>::value,
+      it8512queue::SAFETY);
+  // Checked again on the pool thread, right before the write.
+  if (!co_await exec->offload([&]() {
+        if (stopped()) {
+          return false;
+        }
+        e.psw_sent = std::chrono::steady_clock::now();
+        const bool fired = psw->fireOutput();
+        e.psw_done = std::chrono::steady_clock::now();
+        return fired;
+      })) {
+    ok = false;
   }
-  return true;
+  if (!ok && !stopped()) {
+    std::cout << (mode == 0 ? "关闭电源失败!" : "打开电源失败!") << std::endl;
+  }
+  const bool switched = it8512codec::accepted(co_await load_done);
+  e.load_done = load_done.received();
+  if (stopped()) {
+    co_return false;
+  }
+  if (!switched) {
+    std::cout << (mode == 0 ? "打开电子负载失败!" : "关闭电子负载失败!")
+              << std::endl;
+    ok = false;
+  }
+  co_return ok;
 }
 
-void sweep_ivp(seriallib* it8512, visalib* psw, float set_current,
-               float set_voltage, float ocv, int step, float step_time,
-               int* mode, float* progress, std::vector<float>* time_ivp,
-               std::vector<float>* voltage_ivp, std::vector<float>* current_ivp,
-               std::vector<float>* power_ivp, std::vector<float>* hydrogen_ivp,
-               float temperature, float fuel_flow, float air_flow,
-               int load_type, int sweep_type, int repeat,
-               std::string* str_filename, bool* stop) {
+// Puts a station in its safe state after a stop request: the load off on
+// the safety lane, then the supply off on the executor's safety thread,
+// ahead of anything waiting for the supply. The latency shown is from the
+// request until both are confirmed.
+sweeptask safe_stop(sweepexecutor* exec, station* st) {
+  const std::chrono::steady_clock::time_point requested =
+      st->stop.requestedAt();
+  const bool load_off = it8512codec::accepted(co_await exec->submit(
+      &st->load, it8512codec::fixed<it8512codec::LOAD, 0>::value,
+      it8512queue::SAFETY));
+  if (!load_off) {
+    std::cout << "关闭电子负载失败!" << std::endl;
+  }
+  visalib* psw = &st->psw;
+  const bool psw_off =
+      co_await exec->offloadSafety([psw]() { return psw->outputOff(); });
+  if (load_off && psw_off) {
+    st->stop_latency = std::chrono::duration<float, std::milli>(
+                           std::chrono::steady_clock::now() - requested)
+                           .count();
+  }
+  co_return load_off && psw_off;
+}
+
+std::string sweep_filename_format(int mode, int load_type, int sweep_type) {
+  std::string filename_format;
+  if (mode == 0 && sweep_type == 0) {
+    filename_format = "ivp-fc-%d-%d-%d-%d-%d-%d.csv";
+  } else if (mode == 1 && sweep_type == 0) {
+    filename_format = "ivp-ec-%d-%d-%d-%d-%d-%d.csv";
+  } else if (mode == 0 && load_type == 0 && sweep_type == 1) {
+    filename_format = "load_switch-fc-current-%d-%d-%d-%d-%d-%d.csv";
+  } else if (mode == 0 && load_type == 1 && sweep_type == 1) {
+    filename_format = "voltage_switch-fc-%d-%d-%d-%d-%d-%d.csv";
+  } else if (mode == 1 && sweep_type == 1) {
+    filename_format = "voltage_switch-ec-%d-%d-%d-%d-%d-%d.csv";
+  } else if (mode == 0 && load_type == 1 && sweep_type == 2) {
+    filename_format = "voltage_mode_switch-fcec-%d-%d-%d-%d-%d-%d.csv";
+  }
+  return filename_format;
+}
+
+// Where a station's running sweep keeps its checkpoint.
+static const char* checkpoint_file = "sweep.ckpt";
+
+// Runs a compiled test program; the built-in sweeps and recipe files both
+// go through here. A non-empty `resume` continues an interrupted run after
+// its last checkpointed step, in the same CSV. Runs on `exec`; yields false
+// if the sweep was stopped or could not start.
+sweeptask sweep_ivp(sweepexecutor* exec, station* st, recipe program,
+                    std::string filename_format, dwellsettings dwell,
+                    int refine_budget, bool on_instrument,
+                    sweepcheckpoint resume) {
+  it8512queue* load = &st->load;
+  visalib* psw = &st->psw;
+  int* mode = &st->mode;
+  int* load_type = &st->load_type;
+  float* progress = &st->progress;
+  std::vector<float>* time_ivp = &st->time_ivp;
+  std::vector<float>* voltage_ivp = &st->voltage_ivp;
+  std::vector<float>* current_ivp = &st->current_ivp;
+  std::vector<float>* power_ivp = &st->power_ivp;
+  std::vector<float>* hydrogen_ivp = &st->hydrogen_ivp;
+  std::string* str_filename = &st->str_filename;
+  stopsignal* stop = &st->stop;
+  const float temperature = st->temperature;
+  const float fuel_flow = st->fuel_flow;
+  const float air_flow = st->air_flow;
+  const std::string checkpoint_path = st->path(checkpoint_file);
   time_ivp->clear();
   voltage_ivp->clear();
   current_ivp->clear();
   power_ivp->clear();
   hydrogen_ivp->clear();
+  // Setpoint of each row of the plotted curve, in plot order.
+  std::vector<float> row_x;
+  // Where a row for `input` goes on the plotted curve: a refinement point
+  // between the rows of the two setpoints it splits, so the curve stays in
+  // setpoint order whichever way its current runs; anything else at the end.
+  auto place = [&](float input, bool refined) {
+    size_t position = row_x.size();
+    for (size_t k = 0; refined && k + 1 < row_x.size(); k++) {
+      if ((row_x[k] - input) * (row_x[k + 1] - input) < 0.0f) {
+        position = k + 1;
+        break;
+      }
+    }
+    row_x.insert(row_x.begin() + position, input);
+    return position;
+  };
 
+  const bool resuming = !resume.empty();
   FILE* fp = NULL;
-  time_t now = std::time(0);
-  tm* ltm = localtime(&now);
-  char filename[80];
-  std::string filename_format;
-  if (*mode == 0 && sweep_type == 0) {
-    filename_format = "outputs\\ivp-fc-%d-%d-%d-%d-%d-%d.csv";
-  } else if (*mode == 1 && sweep_type == 0) {
-    filename_format = "outputs\\ivp-ec-%d-%d-%d-%d-%d-%d.csv";
-  } else if (*mode == 0 && load_type == 0 && sweep_type == 1) {
-    filename_format = "outputs\\load_switch-fc-current-%d-%d-%d-%d-%d-%d.csv";
-  } else if (*mode == 0 && load_type == 1 && sweep_type == 1) {
-    filename_format = "outputs\\voltage_switch-fc-%d-%d-%d-%d-%d-%d.csv";
-  } else if (*mode == 1 && sweep_type == 1) {
-    filename_format = "outputs\\voltage_switch-ec-%d-%d-%d-%d-%d-%d.csv";
-  } else if (*mode == 0 && load_type == 1 && sweep_type == 2) {
-    filename_format = "outputs\\voltage_mode_switch-fcec-%d-%d-%d-%d-%d-%d.csv";
+  if (resuming) {
+    program = recipe(resume.steps);
+    dwell = resume.dwell;
+    refine_budget = resume.refine_budget;
+    // The rest of the program runs from the host; an instrument list
+    // would have to be cut at the resume point.
+    on_instrument = false;
+    // Rows written after the checkpoint belong to steps that run again.
+    std::error_code error;
+    std::filesystem::resize_file(resume.filename, resume.offset, error);
+    if (error) {
+      std::cout << "找不到断点对应的数据文件 " << resume.filename << "!"
+                << std::endl;
+      *progress = 0.0f;
+      co_return false;
+    }
+    fp = fopen(resume.filename.c_str(), "r");
+    char row[256];
+    if (fp == NULL || fgets(row, sizeof(row), fp) == NULL) {
+      std::cout << "无法读取断点对应的数据文件 " << resume.filename
+                << ", 放弃续测!" << std::endl;
+      if (fp != NULL) {
+        fclose(fp);
+      }
+      *progress = 0.0f;
+      co_return false;
+    }
+    // The last `added` rows are refinement points; they are placed on the
+    // curve as they were when recorded.
+    const size_t rows = resume.rows.size();
+    for (size_t r = 0; fgets(row, sizeof(row), fp);) {
+      float t, v, i, p, h;
+      if (sscanf(row, "%f,%f,%f,%f,%f", &t, &v, &i, &p, &h) == 5) {
+        const size_t at =
+            r < rows ? place(resume.rows[r], r + resume.added >= rows)
+                     : place(NAN, false);
+        time_ivp->insert(time_ivp->begin() + at, t);
+        voltage_ivp->insert(voltage_ivp->begin() + at, v);
+        current_ivp->insert(current_ivp->begin() + at, i);
+        power_ivp->insert(power_ivp->begin() + at, p);
+        hydrogen_ivp->insert(hydrogen_ivp->begin() + at, h);
+        r++;
+      }
+    }
+    fclose(fp);
+    fp = fopen(resume.filename.c_str(), "a");
+    if (fp == NULL) {
+      std::cout << "无法写入断点对应的数据文件 " << resume.filename
+                << ", 放弃续测!" << std::endl;
+      time_ivp->clear();
+      voltage_ivp->clear();
+      current_ivp->clear();
+      power_ivp->clear();
+      hydrogen_ivp->clear();
+      *progress = 0.0f;
+      co_return false;
+    }
+    *str_filename = resume.filename;
+  } else {
+    time_t now = std::time(0);
+    tm* ltm = localtime(&now);
+    char filename[80];
+    sprintf(filename, filename_format.c_str(), ltm->tm_year + 1900,
+            ltm->tm_mon + 1, ltm->tm_mday, ltm->tm_hour, ltm->tm_min,
+            ltm->tm_sec);
+    const std::string path = st->path(filename);
+
+    fp = fopen(path.c_str(), "a");
+    if (fp == NULL) {
+      std::cout << "无法创建数据文件 " << path << ", 放弃测试!" << std::endl;
+      *progress = 0.0f;
+      co_return false;
+    }
+    fputs(
+        "time,voltage,current,power,hydrogen,mode,temperature,fuel_flow,"
+        "air_flow,load_type,planned_time,schedule_error\n",
+        fp);
+    *str_filename = path;
+  }
+  // A program with mode switches logs each one to a file next to the data;
+  // `gap` is from the load edge to the supply edge, in seconds.
+  std::string filename_switch = *str_filename;
+  filename_switch.insert(filename_switch.size() - 4, "_switch");
+  if (!std::filesystem::exists(filename_switch) &&
+      program.program().end() !=
+          std::find_if(program.program().begin(), program.program().end(),
+                       [](const recipestep& s) {
+                         return s.code == recipestep::MODE;
+                       })) {
+    FILE* fp_switch = fopen(filename_switch.c_str(), "a");
+    if (fp_switch == NULL) {
+      std::cout << "无法创建模式切换记录 " << filename_switch << ", 放弃测试!"
+                << std::endl;
+      fclose(fp);
+      *str_filename = "";
+      *progress = 0.0f;
+      co_return false;
+    }
+    fputs("mode,load_sent,load_done,psw_sent,psw_done,gap\n", fp_switch);
+    fclose(fp_switch);
   }
-  sprintf(filename, filename_format.c_str(), ltm->tm_year + 1900,
-          ltm->tm_mon + 1, ltm->tm_mday, ltm->tm_hour, ltm->tm_min,
-          ltm->tm_sec);
-  *str_filename = filename;
-
-  std::string filename_t = *str_filename;
-  filename_t.insert(filename_t.size() - 4, "_t");
-  FILE* fp_t = fopen(filename_t.c_str(), "a");
-  fputs(
-      "time,voltage,current,power,hydrogen,mode,temperature,fuel_flow,air_flow,"
-      "load_type\n",
-      fp_t);
-  fclose(fp_t);
-
-  fp = fopen(filename, "a");
-  fputs(
-      "time,voltage,current,power,hydrogen,mode,temperature,fuel_flow,air_flow,"
-      "load_type\n",
-      fp);
-  // double start_time = ImGui::GetTime();
-  // double now = ImGui::GetTime();
   double last_time = 0.0;
-  float vcp[3];
-  std::vector<float> inputs;
-  if (sweep_type == 0) {
-    repeat = 1;
-    for (int i = 0; i < step + 1; i++) {
-      if (*mode == 0) {
-        // in current load switch, ocv is i_start
-        inputs.push_back((set_current - ocv) / step * i + ocv);
+  float vcp[3] = {0.0f, 0.0f, 0.0f};
+  const std::vector<recipestep>& steps = program.program();
+  sweepclock schedule;
+  sweepclock::latency set_latency;
+  sweepclock::latency read_latency;
+  // A step that keeps its setpoint has no setpoint latency to plan around.
+  const sweepclock::latency instant;
+  // A current setpoint settles in voltage, everything else in current.
+  auto settling = [&]() { return (*mode == 0 && *load_type == 0) ? 0 : 1; };
+  // Setpoints done so far and their settled responses, in setpoint order.
+  std::vector<float> measured_x = resume.measured_x;
+  std::vector<float> measured_y = resume.measured_y;
+  // Setpoint of each CSV row, in the order the rows were written.
+  std::vector<float> written_x = resume.rows;
+
+  auto apply = [&](float input) -> sweeptask {
+    if (*mode == 0) {
+      if (*load_type == 0) {
+        if (!it8512codec::accepted(
+                co_await exec->submit(load, it8512codec::current(input)))) {
+          std::cout << "设置负载电流失败!" << std::endl;
+        }
+      } else if (*load_type == 1) {
+        if (!it8512codec::accepted(
+                co_await exec->submit(load, it8512codec::voltage(input)))) {
+          std::cout << "设置负载电压失败!" << std::endl;
+        }
+      }
+    } else {
+      if (!co_await exec->offload([&]() { return psw->setVoltage(input); })) {
+        std::cout << "设置电源电压失败!" << std::endl;
+      }
+    }
+    co_return true;
+  };
+  auto read = [&]() -> sweeptask {
+    if (*mode == 1) {
+      measurement m;
+      if (co_await exec->offload([&]() { return psw->measure(m); })) {
+        vcp[0] = m.voltage;
+        vcp[1] = m.current;
+        vcp[2] = m.power;
+      }
+    } else {
+      const it8512codec::reply r = co_await exec->submit(
+          load, it8512codec::fixed<it8512codec::READ_VCP>::value);
+      if (!it8512codec::accepted(r) || r.command != it8512codec::READ_VCP) {
+        std::cout << "读取电压、电流、功率失败!" << std::endl;
       } else {
-        inputs.push_back((set_voltage - ocv) / step * i + ocv);
+        vcp[0] = r.voltage;
+        vcp[1] = r.current;
+        vcp[2] = r.power;
       }
     }
-    // inputs.push_back(ocv);
-  } else {
-    std::vector<float> items;
-    if (sweep_type == 1) {
-      for (int i = 0; i < step + 1; i++) {
-        if (*mode == 0 && load_type == 0) {
-          // in current load switch, ocv is i_start
-          items.push_back((set_current - ocv) / step * i + ocv);
-        } else {
-          items.push_back((set_voltage - ocv) / step * i + ocv);
+    co_return true;
+  };
+  // Issues `op` so that its midpoint lands on `planned` seconds and stores
+  // the actual midpoint; false, without running `op`, if the sweep was
+  // stopped first.
+  auto timed = [&](double planned, sweepclock::latency& l,
+                   std::function<sweeptask()> op,
+                   double* actual) -> sweeptask {
+    if (!co_await exec->sleepUntil(schedule.issueAt(planned, l), stop)) {
+      co_return false;
+    }
+    const sweepclock::clock::time_point sent = sweepclock::clock::now();
+    co_await op();
+    const double midpoint =
+        schedule.finished(sent, sweepclock::clock::now(), l);
+    if (actual != nullptr) {
+      *actual = midpoint;
+    }
+    co_return true;
+  };
+
+  // Records the reading in vcp taken at last_time for one setpoint. Points
+  // added by refinement are inserted where their setpoint belongs on the
+  // curve rather than appended.
+  auto record = [&](float input, double planned_time, bool refined) {
+    const size_t at =
+        std::upper_bound(measured_x.begin(), measured_x.end(), input) -
+        measured_x.begin();
+    measured_x.insert(measured_x.begin() + at, input);
+    measured_y.insert(measured_y.begin() + at, vcp[settling()]);
+
+    const float hydrogen =
+        *mode == 1 ? vcp[1] / 26.801 / 2.0 * 23.8 * 20.0 : 0.0f;
+    const size_t position = place(input, refined);
+    written_x.push_back(input);
+    time_ivp->insert(time_ivp->begin() + position, last_time);
+    voltage_ivp->insert(voltage_ivp->begin() + position, vcp[0]);
+    current_ivp->insert(current_ivp->begin() + position, vcp[1]);
+    power_ivp->insert(power_ivp->begin() + position, vcp[2]);
+    hydrogen_ivp->insert(hydrogen_ivp->begin() + position, hydrogen);
+    fprintf(fp, "%.4f,%.2f,%.3f,%.3f,%.3f,%d,%.1f,%.3f,%.3f,%d,%.4f,%.4f\n",
+            last_time, vcp[0], vcp[1], vcp[2], hydrogen, *mode, temperature,
+            fuel_flow, air_flow, *load_type, planned_time,
+            last_time - planned_time);
+  };
+
+  // Planned start of the next step on the sweep clock.
+  double plan = 0.0;
+  // Runs one step, changing the setpoint to `input` first if `change`, and
+  // records it; returns false if the sweep was stopped.
+  auto run_step = [&](bool change, float input, float seconds,
+                      bool refined) -> sweeptask {
+    std::function<sweeptask()> set = [&]() { return apply(input); };
+    double planned_time = 0.0;
+    if (!dwell.adaptive || !change) {
+      if (change && !co_await timed(plan, set_latency, set, nullptr)) {
+        co_return false;
+      }
+      planned_time =
+          schedule.measureAt(plan, plan + seconds,
+                             change ? set_latency : instant, read_latency);
+      if (!co_await timed(planned_time, read_latency, read, &last_time)) {
+        co_return false;
+      }
+      plan += seconds;
+    } else {
+      // Settling decides when a step ends, so each step starts as soon as
+      // the previous one has settled; readings within it stay on a grid.
+      double step_start = 0.0;
+      if (!co_await timed(0.0, set_latency, set, &step_start)) {
+        co_return false;
+      }
+      steadystate detector(dwell.window, dwell.threshold);
+      for (int j = 1;; j++) {
+        planned_time = step_start + j * dwell.period;
+        if (!co_await timed(planned_time, read_latency, read, &last_time)) {
+          co_return false;
+        }
+        detector.add(last_time, vcp[settling()]);
+        const double dwell_time = last_time - step_start;
+        if (dwell_time >= dwell.max_dwell ||
+            (dwell_time >= dwell.min_dwell && detector.settled())) {
+          break;
         }
       }
+      plan = last_time;
     }
-    if (sweep_type == 2) {
-      for (int i = 0; i < step + 1; i++) {
-        items.push_back((ocv - set_voltage) * 2. / step * i + set_voltage);
-      }
+    record(input, planned_time, refined);
+    co_return true;
+  };
+
+  int total = 0;
+  float refine_seconds = 1.0f;
+  for (const recipestep& s : steps) {
+    if (s.code == recipestep::SET || s.code == recipestep::HOLD) {
+      total++;
     }
-    for (int i = 0; i < items.size(); i++) {
-      for (int j = i + 1; j < items.size(); j++) {
-        inputs.push_back(items[i]);
-        inputs.push_back(items[j]);
-        inputs.push_back(items[i]);
+    if (s.code == recipestep::SET) {
+      refine_seconds = s.seconds;
+    }
+  }
+  const float total_steps = (float)(total + refine_budget);
+  int done = resume.done;
+  int added = resume.added;
+  float setpoint = resume.setpoint;
+  bool stopped = false;
+  bool listed = false;
+
+  // Checkpoints after every completed step, writing at most once a second;
+  // the state of the last step is kept so a stop can still write it.
+  sweepcheckpoint state;
+  state.filename = *str_filename;
+  state.steps = steps;
+  state.dwell = dwell;
+  state.refine_budget = refine_budget;
+  sweepclock::clock::time_point saved;
+  auto checkpoint = [&](int next) {
+    fflush(fp);
+    state.offset = ftell(fp);
+    state.pc = next;
+    state.done = done;
+    state.added = added;
+    state.mode = *mode;
+    state.load_type = *load_type;
+    state.setpoint = setpoint;
+    std::copy(vcp, vcp + 3, state.vcp);
+    state.plan = plan;
+    state.measured_x = measured_x;
+    state.measured_y = measured_y;
+    state.rows = written_x;
+    const sweepclock::clock::time_point now = sweepclock::clock::now();
+    if (now - saved >= std::chrono::seconds(1)) {
+      state.save(checkpoint_path.c_str());
+      saved = now;
+    }
+  };
+
+  if (resuming) {
+    *mode = resume.mode;
+    *load_type = resume.load_type;
+    std::copy(resume.vcp, resume.vcp + 3, vcp);
+    co_await turn_on_output(exec, load, psw, *mode, nullptr, stop);
+    if (*mode == 0 &&
+        !it8512codec::accepted(co_await exec->submit(
+            load, it8512codec::loadType(*load_type)))) {
+      std::cout << "设置负载模式失败!" << std::endl;
+    }
+    co_await apply(setpoint);
+    *progress = done / total_steps;
+    // Test time continues from the checkpoint; the interruption itself is
+    // not part of the record.
+    plan = resume.plan;
+    schedule.start(sweepclock::clock::now() -
+                   std::chrono::duration_cast<sweepclock::clock::duration>(
+                       std::chrono::duration<double>(plan)));
+  } else {
+    schedule.start();
+  }
+  // The instrument setting the operating point (the load, or the supply in
+  // electrolysis) runs the whole program from its own step list and times
+  // the steps itself; the host only reads each step back just before it
+  // ends.
+  if (on_instrument && !dwell.adaptive && program.listable()) {
+    std::vector<float> values;
+    std::vector<float> seconds;
+    for (const recipestep& s : steps) {
+      values.push_back(s.value);
+      seconds.push_back(s.seconds);
+    }
+    seriallib* it8512 = load->device();
+    const bool uploaded = co_await exec->offload([&]() {
+      return *mode == 0 ? it8512->uploadList(*load_type, values.data(),
+                                             seconds.data(),
+                                             (int)values.size())
+                        : psw->uploadList(values.data(), seconds.data(),
+                                          (int)values.size());
+    });
+    if (uploaded) {
+      // One read first, so the end-of-step reads know how early to start.
+      co_await timed(0.0, read_latency, read, nullptr);
+      sweepclock::clock::time_point sent;
+      sweepclock::clock::time_point acked;
+      listed = co_await exec->offload([&]() {
+        sent = sweepclock::clock::now();
+        const bool ok = *mode == 0 ? it8512->trigger() : psw->trigger();
+        acked = sweepclock::clock::now();
+        return ok;
+      });
+      schedule.start(sent + (acked - sent) / 2);
+      // Setpoints change on the instrument's clock, with no latency to plan
+      // for.
+      for (int j = 0; listed && j < (int)values.size(); j++) {
+        const double planned_time =
+            schedule.measureAt(plan, plan + seconds[j], instant, read_latency);
+        if (!co_await timed(planned_time, read_latency, read, &last_time)) {
+          stopped = true;
+          break;
+        }
+        plan += seconds[j];
+        record(values[j], planned_time, false);
+        setpoint = values[j];
+        *progress = ++done / total_steps;
+        checkpoint(j + 1);
       }
     }
+    // Back to fixed mode, holding the final setpoint as a host sweep would.
+    co_await exec->offload([&]() {
+      return *mode == 0 ? it8512->stopList() : psw->stopList();
+    });
+    if (listed && !stopped) {
+      co_await apply(values.back());
+    }
+    if (!listed) {
+      std::cout << "仪器列表模式不可用, 改为逐点扫描!" << std::endl;
+      plan = 0.0;
+      schedule.start();
+    }
   }
-  for (int n = 0; n < repeat; n++) {
-    if (*stop) {
-      *progress = 0;
+
+  for (int pc = resuming ? resume.pc : 0;
+       pc < (int)steps.size() && !stopped && !listed; pc++) {
+    if (stop->requested()) {
+      stopped = true;
       break;
     }
-    for (int i = 0; i < inputs.size(); i++) {
-      // std::cout << inputs[i] << std::endl;
-      if (*stop) {
-        *progress = 0;
+    const recipestep& s = steps[pc];
+    switch (s.code) {
+      case recipestep::MODE: {
+        *mode = (int)s.value;
+        // The first setpoint of the new mode goes to its instrument while
+        // that output is still off, leaving only the two edges at the switch.
+        if (pc + 1 < (int)steps.size() &&
+            steps[pc + 1].code == recipestep::SET) {
+          co_await apply(steps[pc + 1].value);
+        }
+        modeswitch edges;
+        co_await turn_on_output(exec, load, psw, *mode, &edges, stop);
+        const double load_edge =
+            schedule.elapsed(edges.load_sent +
+                             (edges.load_done - edges.load_sent) / 2);
+        const double psw_edge = schedule.elapsed(
+            edges.psw_sent + (edges.psw_done - edges.psw_sent) / 2);
+        FILE* fp_switch = fopen(filename_switch.c_str(), "a");
+        if (fp_switch == NULL) {
+          // Abandoned like a stop, so the station is left safe and the run
+          // can be resumed from its last step.
+          std::cout << "无法写入模式切换记录 " << filename_switch
+                    << ", 放弃测试!" << std::endl;
+          stop->request();
+          stopped = true;
+          break;
+        }
+        fprintf(fp_switch, "%d,%.4f,%.4f,%.4f,%.4f,%.4f\n", *mode,
+                schedule.elapsed(edges.load_sent),
+                schedule.elapsed(edges.load_done),
+                schedule.elapsed(edges.psw_sent),
+                schedule.elapsed(edges.psw_done), psw_edge - load_edge);
+        fclose(fp_switch);
         break;
       }
-      if (n > 0 && i == 0) {
-        continue;
-      }
-      if (sweep_type == 2) {
-        if (i == 0 ||
-            (i > 0 && (inputs[i - 1] - ocv) * (inputs[i] - ocv) <= 0)) {
-          if (inputs[i] <= ocv) {
-            *mode = 0;
-            turn_on_output(it8512, psw, 0);
-          } else {
-            *mode = 1;
-            turn_on_output(it8512, psw, 1);
-          }
+      case recipestep::LOAD:
+        *load_type = (int)s.value;
+        if (!it8512codec::accepted(co_await exec->submit(
+                load, it8512codec::loadType(*load_type)))) {
+          std::cout << "设置负载模式失败!" << std::endl;
         }
-      }
-      if (*mode == 0) {
-        if (load_type == 0) {
-          if (!it8512->setCurrent(inputs[i])) {
-            std::cout << "设置负载电流失败!" << std::endl;
-          }
-        } else if (load_type == 1) {
-          if (!it8512->setVoltage(inputs[i])) {
-            std::cout << "设置负载电压失败!" << std::endl;
-          }
+        break;
+      case recipestep::SET:
+        setpoint = s.value;
+        stopped = !co_await run_step(true, s.value, s.seconds, false);
+        if (!stopped) {
+          *progress = ++done / total_steps;
+          checkpoint(pc + 1);
         }
-      } else {
-        if (!psw->setVoltage(inputs[i])) {
-          std::cout << "设置电源电压失败!" << std::endl;
+        break;
+      case recipestep::HOLD:
+        stopped = !co_await run_step(false, setpoint, s.seconds, false);
+        if (!stopped) {
+          *progress = ++done / total_steps;
+          checkpoint(pc + 1);
         }
+        break;
+      case recipestep::JUMP_IF: {
+        const float x = s.variable == 'V'   ? vcp[0]
+                        : s.variable == 'I' ? vcp[1]
+                                            : vcp[2];
+        if (s.compare == '<' ? x < s.value : x > s.value) {
+          pc = s.target - 1;
+        }
+        break;
       }
-
-      // Sleep(step_time * 1000);
-      std::this_thread::sleep_for(
-          std::chrono::milliseconds(int(step_time * 1000)));
-      last_time = step_time * i;
-      if (!it8512->readVCP(vcp)) {
-        std::cout << "读取电压、电流、功率失败!" << std::endl;
-      }
-      if (*mode == 1) {
-        vcp[1] = psw->readCurrent();
-        vcp[2] = vcp[1] * vcp[2];
+    }
+  }
+  // Adaptive VI curve: after the coarse pass, keep splitting the intervals
+  // where the measured curve bends most until the point budget is used. A
+  // coarse pass run as an instrument list is refined from the host, with
+  // the instrument back in fixed mode.
+  while (!stopped && added < refine_budget) {
+    const std::vector<float> extra =
+        refineSetpoints(measured_x, measured_y, refine_budget - added);
+    if (extra.empty()) {
+      break;
+    }
+    for (float x : extra) {
+      if (!co_await run_step(true, x, refine_seconds, true)) {
+        stopped = true;
+        break;
       }
+      added++;
+      setpoint = x;
+      *progress = ++done / total_steps;
+      checkpoint((int)steps.size());
+    }
+  }
+  *progress = stopped ? 0.0f : 1.0f;
+  fclose(fp);
+  if (!stopped) {
+    std::remove(checkpoint_path.c_str());
+  } else if (state.offset > 0) {
+    // Keep the last completed step on disk so the run can be resumed.
+    state.save(checkpoint_path.c_str());
+  }
+  *str_filename = "";
+  // The UI already put the station in its safe state; repeat it in case a
+  // mode switch in this sweep raced with the stop.
+  if (stop->requested()) {
+    load->loadOff(it8512queue::SAFETY);
+    if (!co_await exec->offloadSafety([psw]() { return psw->outputOff(); })) {
+      std::cout << "关闭电源失败!" << std::endl;
+    }
+  }
+  co_return !stopped;
+}
+
+// The title of a station's window; with several stations each window is
+// tagged with its station.
+static std::string title(const char* name, const station& st) {
+  return st.label.empty() ? std::string(name) : name + (" - " + st.label);
+}
+
+// Draws the windows of one station.
+static void draw_station(station& st, sweepexecutor* exec,
+                         bool* setting_window_status) {
+  ImGui::Begin(title("运行状态", st).c_str());
+  if ((st.progress > 0.999f) || (st.progress < 0.001f)) {
+    if (ImGui::RadioButton("发电模式", &st.mode, 0)) {
+      st.sweep_type = 0;
+      st.load_type = 0;
+      exec->spawn(turn_on_output(exec, &st.load, &st.psw, 0));
+    }
+    ImGui::SameLine();
+    if (ImGui::RadioButton("电解模式", &st.mode, 1)) {
+      st.sweep_type = 0;
+      exec->spawn(turn_on_output(exec, &st.load, &st.psw, 1));
+    }
+  } else {
+    if (st.mode == 0) {
+      ImGui::TextColored(ImVec4(0.0f, 0.0f, 0.8f, 1.0f), "发电模式扫描中...");
+    } else {
+      ImGui::TextColored(ImVec4(0.0f, 0.0f, 0.8f, 1.0f), "电解模式扫描中...");
+    }
+  }
+
+  if (st.voltage.size() > 0) {
+    ImGui::Text("电压: %.2f  V", st.voltage.back());
+    ImGui::Text("电流: %.3f A", st.current.back());
+    ImGui::Text("功率: %.3f W", st.power.back());
+  }
+  if (st.mode == 1) {
+    ImGui::Text("产氢率: %.3f NL/h", st.hydrogen.back());
+  }
 
-      // std::cout << last_time << ": " << *vcp << "," << *(vcp + 1) << ","
-      //           << *(vcp + 2) << "," << std::endl;
-      time_ivp->push_back(last_time);
-      voltage_ivp->push_back(*vcp);
-      current_ivp->push_back(*(vcp + 1));
-      power_ivp->push_back(*(vcp + 2));
-      if (*mode == 1) {
-        hydrogen_ivp->push_back(*(vcp + 1) / 26.801 / 2.0 * 23.8 * 20.0);
+  ImGui::DragFloat("温度 (°C)", &st.temperature, 10.0, 0.0, 1000.0, "%.1f");
+  ImGui::DragFloat("燃料流速 (L/min)", &st.fuel_flow, 0.1, 0.0, 20.0,
+                   "%.3f");
+  ImGui::DragFloat("空气流速 (L/min)", &st.air_flow, 0.1, 0.0, 100.0,
+                   "%.3f");
+  ImGui::Text("FPS %.1f", ImGui::GetIO().Framerate);
+  ImGui::Checkbox("设置", setting_window_status);
+  ImGui::PushStyleColor(ImGuiCol_PlotHistogram,
+                        ImVec4(0.10, 0.45, 0.91, 1.00));
+  if (st.power.size() > 0) {
+    if (st.mode == 0) {
+      char buf[32];
+      sprintf(buf, "%.1f / %.1f W", st.power.back(), st.biggest_p);
+      ImGui::ProgressBar(st.power.back() / st.biggest_p, ImVec2(0.0f, 0.0f),
+                         buf);
+    } else {
+      char buf[32];
+      sprintf(buf, "%.1f / %.1f NL/h", st.hydrogen.back(), st.biggest_h);
+      ImGui::ProgressBar(st.hydrogen.back() / st.biggest_h,
+                         ImVec2(0.0f, 0.0f), buf);
+    }
+  }
+  ImGui::PopStyleColor();
+  ImGui::End();
+
+  ImGui::Begin(title("测试参数", st).c_str());
+  if (st.mode == 0) {
+    if (ImGui::RadioButton("负载电流", &st.load_type, 0)) {
+      st.set_current = 0.0f;
+      st.sweep_type = 0;
+      st.step = 20;
+      st.load.setCurrent(st.set_current);
+      st.load.setLoadType(0);
+    }
+    ImGui::SameLine();
+    if (ImGui::RadioButton("负载电压", &st.load_type, 1)) {
+      st.set_load_voltage = 30.0f;
+      st.sweep_type = 1;
+      st.step = 1;
+      st.load.setVoltage(st.set_load_voltage);
+      st.load.setLoadType(1);
+    }
+  }
+
+  if (st.mode == 0) {
+    if (st.load_type == 0) {
+      ImGui::DragFloat("负载电流 (A)", &st.set_current, 0.5, 0.0, 20.0);
+    } else {
+      ImGui::DragFloat("负载电压 (V)", &st.set_load_voltage, 0.5, 0.0,
+                       30.0);
+    }
+  } else {
+    ImGui::DragFloat("电源电压 (V)", &st.set_voltage, 0.5, 0.0, 50.0);
+  }
+  if (ImGui::Button("确定")) {
+    if (st.mode == 0) {
+      if (st.load_type == 0) {
+        st.load.setCurrent(st.set_current);
       } else {
-        hydrogen_ivp->push_back(0.0f);
+        st.load.setVoltage(st.set_load_voltage);
       }
-      fprintf(fp, "%.4f,%.2f,%.3f,%.3f,%.3f,%d,%.1f,%.3f,%.3f,%d\n", last_time,
-              voltage_ivp->back(), current_ivp->back(), power_ivp->back(),
-              hydrogen_ivp->back(), *mode, temperature, fuel_flow, air_flow,
-              load_type);
-      *progress =
-          1.0 / (repeat * (inputs.size() - 1)) * (n * (inputs.size() - 1) + i);
+    } else {
+      st.psw.setVoltage(st.set_voltage);
     }
   }
-  fclose(fp);
-  *str_filename = "";
+  if (st.mode == 1 || st.load_type == 1) {
+    ImGui::DragFloat("OCV (V)", &st.ocv, 0.5, 0.0, 35.0);
+  } else if (st.mode == 0 && st.load_type == 0) {
+    ImGui::DragFloat("起始电流 (A)", &st.occ, 0.5, 0.0, 20.0);
+  }
+  if (st.mode == 1 || st.load_type == 0) {
+    if (ImGui::RadioButton("VI曲线", &st.sweep_type, 0)) {
+      st.step = 20;
+    }
+  }
+  if (st.mode == 0 && st.load_type == 0) {
+    ImGui::SameLine();
+    if (ImGui::RadioButton("负载电流切换", &st.sweep_type, 1)) {
+      st.step = 1;
+    }
+  } else if (st.mode == 0 && st.load_type == 1) {
+    if (ImGui::RadioButton("负载电压切换", &st.sweep_type, 1)) {
+      st.step = 1;
+    }
+  } else {
+    ImGui::SameLine();
+    if (ImGui::RadioButton("电源电压切换", &st.sweep_type, 1)) {
+      st.step = 1;
+    }
+  }
+  if (st.mode == 0 && st.load_type == 1) {
+    ImGui::SameLine();
+    if (ImGui::RadioButton("模式切换", &st.sweep_type, 2)) {
+      st.step = 1;
+    }
+  }
+
+  ImGui::DragInt("扫描步数 ", &st.step, 1, 1, 50);
+  ImGui::DragFloat("扫描步长 (s)", &st.step_time, 0.1, 0.05, 10.0);
+  if (st.sweep_type != 2 && !st.dwell.adaptive) {
+    ImGui::Checkbox("仪器列表模式", &st.on_instrument);
+  }
+  ImGui::Checkbox("稳态判据", &st.dwell.adaptive);
+  if (st.dwell.adaptive) {
+    ImGui::DragFloat("稳态阈值 (V/s 或 A/s)", &st.dwell.threshold, 0.001,
+                     0.0001, 1.0, "%.4f");
+    ImGui::DragFloat("判据窗口 (s)", &st.dwell.window, 0.1, 0.2, 10.0);
+    ImGui::DragFloat("最短停留 (s)", &st.dwell.min_dwell, 0.1, 0.0, 60.0);
+    ImGui::DragFloat("最长停留 (s)", &st.dwell.max_dwell, 1.0, 1.0, 600.0);
+  }
+  ImGui::DragInt("重复次数 ", &st.repeat, 1, 1, 20);
+  if (st.sweep_type == 0) {
+    ImGui::Checkbox("自适应加密", &st.refine);
+    if (st.refine) {
+      ImGui::SameLine();
+      ImGui::DragInt("加密点数", &st.refine_budget, 1, 1, 100);
+    }
+  }
+  if (ImGui::Button("扫描") &&
+      ((st.progress > 0.999f) || (st.progress < 0.001f))) {
+    st.stop.reset();
+    float set_voltage_input;
+    float ocv_input;
+    if (st.mode == 0) {
+      set_voltage_input = st.set_load_voltage;
+    } else {
+      set_voltage_input = st.set_voltage;
+    }
+    if (st.mode == 0 && st.load_type == 0) {
+      ocv_input = st.occ;
+    } else {
+      ocv_input = st.ocv;
+    }
+    exec->spawn(sweep_ivp(
+        exec, &st,
+        recipe::builtin(st.mode, st.load_type, st.sweep_type, st.set_current,
+                        set_voltage_input, ocv_input, st.step, st.step_time,
+                        st.repeat),
+        sweep_filename_format(st.mode, st.load_type, st.sweep_type), st.dwell,
+        st.refine && st.sweep_type == 0 ? st.refine_budget : 0,
+        st.on_instrument && !st.dwell.adaptive, sweepcheckpoint()));
+  }
+  ImGui::InputText("配方文件", st.recipe_path, IM_ARRAYSIZE(st.recipe_path));
+  ImGui::SameLine();
+  if (ImGui::Button("运行配方") &&
+      ((st.progress > 0.999f) || (st.progress < 0.001f))) {
+    recipe program;
+    if (program.load(st.recipe_path)) {
+      st.stop.reset();
+      exec->spawn(sweep_ivp(exec, &st, program, "recipe-%d-%d-%d-%d-%d-%d.csv",
+                            st.dwell, 0, st.on_instrument && !st.dwell.adaptive,
+                            sweepcheckpoint()));
+    }
+  }
+  const std::string checkpoint_path = st.path(checkpoint_file);
+  if (((st.progress > 0.999f) || (st.progress < 0.001f)) &&
+      std::filesystem::exists(checkpoint_path)) {
+    if (ImGui::Button("继续上次扫描")) {
+      sweepcheckpoint resume;
+      if (resume.load(checkpoint_path.c_str())) {
+        st.stop.reset();
+        exec->spawn(sweep_ivp(exec, &st, recipe(), std::string(), st.dwell, 0,
+                              false, resume));
+      }
+    }
+  }
+  ImGui::SameLine();
+  if (ImGui::Button("停止")) {
+    // Put the hardware in its safe state first; both outputs go off ahead
+    // of anything the sweep has queued.
+    st.stop.request();
+    exec->wake();
+    st.progress = 0.0f;
+    exec->spawn(safe_stop(exec, &st));
+  }
+  if (st.stop_latency >= 0.0f) {
+    ImGui::SameLine();
+    ImGui::Text("停止耗时: %.1f ms", (float)st.stop_latency);
+  }
+  // ImGui::PushStyleColor(ImGuiCol_FrameBg,
+  //                       (ImVec4)ImColor::ImColor(252, 252, 252, 256));
+  ImGui::PushStyleColor(ImGuiCol_PlotHistogram,
+                        ImVec4(0.10, 0.45, 0.91, 1.00));
+  ImGui::ProgressBar(st.progress, ImVec2(0.0f, 0.0f));
+  ImGui::PopStyleColor();
+
+  ImGui::End();
+
+  ImGui::Begin(title("测试结果", st).c_str());
+  float smallest_c_ivp = 0;
+  float biggest_c_ivp = 10;
+  if (st.current_ivp.size() > 0) {
+    smallest_c_ivp =
+        *std::min_element(st.current_ivp.begin(), st.current_ivp.end()) - 0.03;
+    biggest_c_ivp =
+        *std::max_element(st.current_ivp.begin(), st.current_ivp.end()) + 0.03;
+  }
+  float smallest_v_ivp = 0;
+  float biggest_v_ivp = 35;
+  if (st.voltage_ivp.size() > 0) {
+    smallest_v_ivp =
+        *std::min_element(st.voltage_ivp.begin(), st.voltage_ivp.end()) - 0.03;
+    biggest_v_ivp =
+        *std::max_element(st.voltage_ivp.begin(), st.voltage_ivp.end()) + 0.03;
+  }
+  float smallest_p_ivp = 0;
+  float biggest_p_ivp = 150;
+  if (st.power_ivp.size() > 0) {
+    smallest_p_ivp =
+        *std::min_element(st.power_ivp.begin(), st.power_ivp.end()) - 0.03;
+    biggest_p_ivp =
+        *std::max_element(st.power_ivp.begin(), st.power_ivp.end()) + 0.03;
+  }
+  ImPlot::SetNextPlotLimits(smallest_c_ivp, biggest_c_ivp, smallest_v_ivp,
+                            biggest_v_ivp, ImGuiCond_Always);
+  ImPlot::SetNextPlotLimitsY(smallest_p_ivp, biggest_p_ivp, ImGuiCond_Always,
+                             1);
+  if (ImPlot::BeginPlot("IVP曲线", "电流 (A)", "电压 (V)", ImVec2(-1, -1),
+                        ImPlotFlags_NoTitle | ImPlotFlags_YAxis2,
+                        ImPlotAxisFlags_AutoFit, ImPlotAxisFlags_AutoFit,
+                        ImPlotAxisFlags_NoGridLines,
+                        ImPlotAxisFlags_NoGridLines, "功率 (W)")) {
+    ImPlot::PlotLine("电压", st.current_ivp.data(), st.voltage_ivp.data(),
+                     st.current_ivp.size());
+    ImPlot::SetPlotYAxis(ImPlotYAxis_2);
+    ImPlot::PlotLine("功率", st.current_ivp.data(), st.power_ivp.data(),
+                     st.current_ivp.size());
+    ImPlot::EndPlot();
+  }
+  ImGui::End();
+
+  // ImGui::ShowDemoWindow();
+  // ImPlot::ShowDemoWindow();
+  ImGui::Begin(title("电压", st).c_str());
+  ImPlot::SetNextPlotLimits(0, st.last_time, st.smallest_v, st.biggest_v,
+                            ImGuiCond_Always);
+  if (ImPlot::BeginPlot("电压", "时间 (s)", "电压 (V)", ImVec2(-1, -1),
+                        ImPlotFlags_NoTitle | ImPlotFlags_NoLegend,
+                        ImPlotAxisFlags_None, ImPlotAxisFlags_None)) {
+    ImPlot::PushStyleColor(ImPlotCol_Line, ImPlot::GetColormapColor(0));
+    ImPlot::PlotLine("电压", st.time.data(), st.voltage.data(),
+                     st.time.size());
+    ImPlot::PopStyleColor();
+    ImPlot::EndPlot();
+  }
+  ImGui::End();
+
+  ImGui::Begin(title("电流", st).c_str());
+
+  ImPlot::SetNextPlotLimits(0, st.last_time, st.smallest_c, st.biggest_c,
+                            ImGuiCond_Always);
+  if (ImPlot::BeginPlot("电流", "时间 (s)", "电流 (A)", ImVec2(-1, -1),
+                        ImPlotFlags_NoTitle | ImPlotFlags_NoLegend,
+                        ImPlotAxisFlags_None, ImPlotAxisFlags_None)) {
+    ImPlot::PushStyleColor(ImPlotCol_Line, ImPlot::GetColormapColor(4));
+    ImPlot::PlotLine("电流", st.time.data(), st.current.data(),
+                     st.time.size());
+    ImPlot::PopStyleColor();
+    ImPlot::EndPlot();
+  }
+  ImGui::End();
+
+  ImGui::Begin(title("功率", st).c_str());
+  ImPlot::SetNextPlotLimits(0, st.last_time, st.smallest_p, st.biggest_p,
+                            ImGuiCond_Always);
+  if (ImPlot::BeginPlot("功率", "时间 (s)", "功率 (W)", ImVec2(-1, -1),
+                        ImPlotFlags_NoTitle | ImPlotFlags_NoLegend,
+                        ImPlotAxisFlags_None, ImPlotAxisFlags_None)) {
+    ImPlot::PushStyleColor(ImPlotCol_Line, ImPlot::GetColormapColor(1));
+    ImPlot::PlotLine("功率", st.time.data(), st.power.data(), st.time.size());
+    ImPlot::PopStyleColor();
+    ImPlot::EndPlot();
+  }
+  ImGui::End();
+
+  if (st.mode == 1) {
+    ImGui::Begin(title("产氢率", st).c_str());
+
+    ImPlot::SetNextPlotLimits(0, st.last_time, st.smallest_h, st.biggest_h,
+                              ImGuiCond_Always);
+    if (ImPlot::BeginPlot("产氢率", "时间 (s)", "产氢率 (NL/h)",
+                          ImVec2(-1, -1),
+                          ImPlotFlags_NoTitle | ImPlotFlags_NoLegend,
+                          ImPlotAxisFlags_None, ImPlotAxisFlags_None)) {
+      ImPlot::PushStyleColor(ImPlotCol_Line, ImPlot::GetColormapColor(2));
+      ImPlot::PlotLine("产氢率", st.time.data(), st.hydrogen.data(),
+                       st.time.size());
+      ImPlot::PopStyleColor();
+      ImPlot::EndPlot();
+    }
+    ImGui::End();
+  }
 }
 
 int main(int, char**) {
@@ -726,49 +1526,35 @@ int main(int, char**) {
   }
 
   // Our state
-  static int mode = 0;
-  static int load_type = 0;
-  static int sweep_type = 0;
-  static float progress = 0.0f;
   static float readFreq = 25.0f;
+  static float logInterval = 1.0f;
   ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
   static bool setting_window_status = false;
-  static std::string str_filename = "";
-  // inital serial
-  seriallib it8512("COM5");
-  if (!it8512.loadOn() || !it8512.setLoadType(0)) {
-    std::cout << "打开电子负载失败!" << std::endl;
-  }
-  visalib psw("ASRL4::INSTR");
-  if (!psw.output(false)) {
-    std::cout << "关闭电源失败!" << std::endl;
+  // Runs every station's sweeps. Declared first so it outlives the stations
+  // whose queues resume them; cleanup drains it before the stations go.
+  sweepexecutor executor;
+#ifdef __linux__
+  // One I/O thread for every station's load port, declared before the
+  // stations so it outlives them.
+  reactorthread serial_io;
+#endif
+  // One set of instruments, workers and logs per stack in stations.txt.
+  const std::vector<stationconfig> configs = loadStations("stations.txt");
+  std::vector<std::unique_ptr<station>> stations;
+  for (size_t i = 0; i < configs.size(); i++) {
+    // A single station keeps the output layout of the single-stack app.
+    const std::string directory =
+        configs.size() == 1 ? "outputs"
+                            : "outputs\\station" + std::to_string(i + 1);
+#ifdef __linux__
+    stations.emplace_back(new station(configs[i], directory, serial_io.get()));
+#else
+    stations.emplace_back(new station(configs[i], directory));
+#endif
+    if (configs.size() > 1) {
+      stations.back()->label = configs[i].name;
+    }
   }
-  float vcp[3];
-  double last_time = ImGui::GetTime();
-
-  std::vector<float> time = {};
-  std::vector<float> voltage = {};
-  std::vector<float> current = {};
-  std::vector<float> power = {};
-  std::vector<float> hydrogen = {};
-  float temperature = 700.0f;
-  float fuel_flow = 0.0f;
-  float air_flow = 20.0f;
-
-  std::vector<float> time_ivp = {};
-  std::vector<float> voltage_ivp = {};
-  std::vector<float> current_ivp = {};
-  std::vector<float> power_ivp = {};
-  std::vector<float> hydrogen_ivp = {};
-
-  static float smallest_c = 0;
-  static float biggest_c = 10;
-  static float smallest_v = 0;
-  static float biggest_v = 30;
-  static float smallest_p = 0;
-  static float biggest_p = 200;
-  static float smallest_h = smallest_c / 26.801 / 2.0 * 23.8 * 20.0;
-  static float biggest_h = biggest_c / 26.801 / 2.0 * 23.8 * 20.0;
 
   ImGui::StyleColorsLight();
   ImPlot::StyleColorsLight();
@@ -776,89 +1562,15 @@ int main(int, char**) {
   style.AntiAliasedLines = true;
   style.LineWeight = 1.5;
   ImPlot::PushColormap("Dark");
-  // system("cd %~dp0");
-  system("if not exist outputs mkdir outputs");
-  FILE* fp = NULL;
-  time_t now = std::time(0);
-  tm* ltm = localtime(&now);
-  char filename[80];
-  sprintf(filename, "outputs\\data%d-%d-%d-%d-%d-%d.csv", ltm->tm_year + 1900,
-          ltm->tm_mon + 1, ltm->tm_mday, ltm->tm_hour, ltm->tm_min,
-          ltm->tm_sec);
-  fp = fopen(filename, "a");
-  fputs(
-      "time,voltage,current,power,hydrogen,mode,temperature,fuel_flow,air_"
-      "flow,load_type\n",
-      fp);
 
   // Main loop
   while (!glfwWindowShouldClose(window)) {
-    if (ImGui::GetTime() - last_time > 1.0f / readFreq) {
-      if (!it8512.readVCP(vcp)) {
-        std::cout << "读取电压、电流、功率失败!" << std::endl;
-      }
-      if (mode == 1) {
-        vcp[1] = psw.readCurrent();
-        vcp[2] = vcp[0] * vcp[1];
-      }
-
-      last_time = ImGui::GetTime();
-      // std::cout << last_time << ": " << *vcp << "," << *(vcp + 1) << ","
-      //           << *(vcp + 2) << "," << std::endl;
-      time.push_back(last_time);
-      voltage.push_back(*vcp);
-      current.push_back(*(vcp + 1));
-      power.push_back(*(vcp + 2));
-      if (mode == 1) {
-        hydrogen.push_back(*(vcp + 1) / 26.801 / 2.0 * 23.8 * 20.0);
-      } else {
-        hydrogen.push_back(0.0f);
-      }
-      fprintf(fp, "%.4f,%.2f,%.3f,%.3f,%.3f,%d,%.1f,%.3f,%.3f,%d\n", last_time,
-              voltage.back(), current.back(), power.back(), hydrogen.back(),
-              mode, temperature, fuel_flow, air_flow, load_type);
-      std::cout << str_filename.size() << std::endl;
-      if (str_filename.size() > 4) {
-        std::string filename_t = str_filename;
-        filename_t.insert(filename_t.size() - 4, "_t");
-        FILE* fp_t = fopen(filename_t.c_str(), "a");
-        fprintf(fp_t, "%.4f,%.2f,%.3f,%.3f,%.3f,%d,%.1f,%.3f,%.3f,%d\n",
-                last_time, voltage.back(), current.back(), power.back(),
-                hydrogen.back(), mode, temperature, fuel_flow, air_flow,
-                load_type);
-        fclose(fp_t);
-      }
-      if (current.size() > 1) {
-        smallest_c = min(current.back() - 0.03, smallest_c);
-        biggest_c = max(current.back() + 0.03, biggest_c);
-      } else if (current.size() == 1) {
-        smallest_c = current[0] - 0.03;
-        biggest_c = current[0] + 0.03;
-      }
-
-      if (voltage.size() > 1) {
-        smallest_v = min(voltage.back() - 0.03, smallest_v);
-        biggest_v = max(voltage.back() + 0.03, biggest_v);
-      } else if (voltage.size() == 1) {
-        smallest_v = voltage[0] - 0.03;
-        biggest_v = voltage[0] + 0.03;
-      }
-
-      if (power.size() > 1) {
-        smallest_p = min(power.back() - 0.03, smallest_p);
-        biggest_p = max(power.back() + 0.03, biggest_p);
-      } else if (power.size() == 1) {
-        smallest_p = power[0] - 0.03;
-        biggest_p = power[0] + 0.03;
-      }
-
-      if (hydrogen.size() > 1) {
-        smallest_h = min(hydrogen.back() - 0.03, smallest_h);
-        biggest_h = max(hydrogen.back() + 0.03, biggest_h);
-      } else if (power.size() == 1) {
-        smallest_h = hydrogen[0] - 0.03;
-        biggest_h = hydrogen[0] + 0.03;
-      }
+    for (std::unique_ptr<station>& st : stations) {
+      st->acq.setFrequency(readFreq);
+      st->acq.setMode(st->mode);
+      // Drain everything the acquisition thread produced since the last
+      // frame.
+      st->drain();
     }
     // Poll and handle events (inputs, window resize, etc.)
     // You can read the io.WantCaptureMouse, io.WantCaptureKeyboard flags to
@@ -897,285 +1609,48 @@ int main(int, char**) {
 
     // 2. Show a simple window that we create ourselves. We use a Begin/End
     // pair to created a named window.
-    ImGui::Begin("运行状态");  // Pass a pointer to our bool variable (the
-                               // window will have a closing button that will
-                               // clear the bool when clicked)
-    if ((progress > 0.999f) || (progress < 0.001f)) {
-      if (ImGui::RadioButton("发电模式", &mode, 0)) {
-        sweep_type = 0;
-        load_type = 0;
-        turn_on_output(&it8512, &psw, 0);
-      }
-      ImGui::SameLine();
-      if (ImGui::RadioButton("电解模式", &mode, 1)) {
-        sweep_type = 0;
-        turn_on_output(&it8512, &psw, 1);
-      }
-    } else {
-      if (mode == 0) {
-        ImGui::TextColored(ImVec4(0.0f, 0.0f, 0.8f, 1.0f), "发电模式扫描中...");
-      } else {
-        ImGui::TextColored(ImVec4(0.0f, 0.0f, 0.8f, 1.0f), "电解模式扫描中...");
-      }
+    for (std::unique_ptr<station>& st : stations) {
+      draw_station(*st, &executor, &setting_window_status);
     }
 
-    if (voltage.size() > 0) {
-      ImGui::Text("电压: %.2f  V", voltage.back());
-      ImGui::Text("电流: %.3f A", current.back());
-      ImGui::Text("功率: %.3f W", power.back());
-    }
-    if (mode == 1) {
-      ImGui::Text("产氢率: %.3f NL/h", hydrogen.back());
-    }
-
-    ImGui::DragFloat("温度 (°C)", &temperature, 10.0, 0.0, 1000.0, "%.1f");
-    ImGui::DragFloat("燃料流速 (L/min)", &fuel_flow, 0.1, 0.0, 20.0, "%.3f");
-    ImGui::DragFloat("空气流速 (L/min)", &air_flow, 0.1, 0.0, 100.0, "%.3f");
-    ImGui::Text("FPS %.1f", ImGui::GetIO().Framerate);
-    ImGui::Checkbox("设置", &setting_window_status);
-    ImGui::PushStyleColor(ImGuiCol_PlotHistogram,
-                          ImVec4(0.10, 0.45, 0.91, 1.00));
-    if (power.size() > 0) {
-      if (mode == 0) {
-        char buf[32];
-        sprintf(buf, "%.1f / %.1f W", power.back(), biggest_p);
-        ImGui::ProgressBar(power.back() / biggest_p, ImVec2(0.0f, 0.0f), buf);
-      } else {
-        char buf[32];
-        sprintf(buf, "%.1f / %.1f NL/h", hydrogen.back(), biggest_h);
-        ImGui::ProgressBar(hydrogen.back() / biggest_h, ImVec2(0.0f, 0.0f),
-                           buf);
-      }
-    }
-    ImGui::PopStyleColor();
-    ImGui::End();
-
     if (setting_window_status) {
       ImGui::Begin("设置", &setting_window_status);
       ImGui::ShowStyleSelector("界面样式");
       ImPlot::ShowStyleSelector("绘图样式");
       ImPlot::ShowColormapSelector("图线颜色");
       ImGui::Checkbox("图线抗锯齿", &ImPlot::GetStyle().AntiAliasedLines);
-      ImGui::DragFloat("采样频率 (Hz)", &readFreq, 1.0, 1.0, 60.0);
-      ImGui::End();
-    }
-    static float set_current = 0.0f;
-    static float ocv = 30.0f;
-    static float occ = 0.0f;
-    static float set_load_voltage = 30.0f;
-    static float set_voltage = 0.0f;
-    static int step = 20;
-    static float step_time = 1.0;
-    static int repeat = 1;
-    static bool stop = false;
-
-    ImGui::Begin("测试参数");
-    if (mode == 0) {
-      if (ImGui::RadioButton("负载电流", &load_type, 0)) {
-        set_current = 0.0f;
-        sweep_type = 0;
-        step = 20;
-        it8512.setCurrent(set_current);
-        it8512.setLoadType(0);
-      }
-      ImGui::SameLine();
-      if (ImGui::RadioButton("负载电压", &load_type, 1)) {
-        set_load_voltage = 30.0f;
-        sweep_type = 1;
-        step = 1;
-        it8512.setVoltage(set_load_voltage);
-        it8512.setLoadType(1);
+      ImGui::DragFloat("采样频率 (Hz)", &readFreq, 1.0, 1.0, 200.0);
+#ifdef __linux__
+      bool uring = logstore::selected() == logstore::URING;
+      if (ImGui::Checkbox("io_uring 写盘 (新日志文件生效)", &uring)) {
+        logstore::select(uring ? logstore::URING : logstore::BUFFERED);
       }
-    }
-
-    if (mode == 0) {
-      if (load_type == 0) {
-        ImGui::DragFloat("负载电流 (A)", &set_current, 0.5, 0.0, 20.0);
-      } else {
-        ImGui::DragFloat("负载电压 (V)", &set_load_voltage, 0.5, 0.0, 30.0);
-      }
-    } else {
-      ImGui::DragFloat("电源电压 (V)", &set_voltage, 0.5, 0.0, 50.0);
-    }
-    if (ImGui::Button("确定")) {
-      if (mode == 0) {
-        if (load_type == 0) {
-          it8512.setCurrent(set_current);
-        } else {
-          it8512.setVoltage(set_load_voltage);
+#endif
+      if (ImGui::DragFloat("日志写盘间隔 (s)", &logInterval, 0.1, 0.1, 60.0)) {
+        for (std::unique_ptr<station>& st : stations) {
+          st->logger.setFlushInterval(logInterval);
         }
-      } else {
-        psw.setVoltage(set_voltage);
-      }
-    }
-    if (mode == 1 || load_type == 1) {
-      ImGui::DragFloat("OCV (V)", &ocv, 0.5, 0.0, 35.0);
-    } else if (mode == 0 && load_type == 0) {
-      ImGui::DragFloat("起始电流 (A)", &occ, 0.5, 0.0, 20.0);
-    }
-    if (mode == 1 || load_type == 0) {
-      if (ImGui::RadioButton("VI曲线", &sweep_type, 0)) {
-        step = 20;
-      }
-    }
-    if (mode == 0 && load_type == 0) {
-      ImGui::SameLine();
-      if (ImGui::RadioButton("负载电流切换", &sweep_type, 1)) {
-        step = 1;
-      }
-    } else if (mode == 0 && load_type == 1) {
-      if (ImGui::RadioButton("负载电压切换", &sweep_type, 1)) {
-        step = 1;
-      }
-    } else {
-      ImGui::SameLine();
-      if (ImGui::RadioButton("电源电压切换", &sweep_type, 1)) {
-        step = 1;
       }
-    }
-    if (mode == 0 && load_type == 1) {
-      ImGui::SameLine();
-      if (ImGui::RadioButton("模式切换", &sweep_type, 2)) {
-        step = 1;
-      }
-    }
-
-    ImGui::DragInt("扫描步数 ", &step, 1, 1, 50);
-    ImGui::DragFloat("扫描步长 (s)", &step_time, 0.5, 0.5, 10.0);
-    ImGui::DragInt("重复次数 ", &repeat, 1, 1, 20);
-    if (ImGui::Button("扫描") && ((progress > 0.999f) || (progress < 0.001f))) {
-      stop = false;
-      float set_voltage_input;
-      float ocv_input;
-      if (mode == 0) {
-        set_voltage_input = set_load_voltage;
-      } else {
-        set_voltage_input = set_voltage;
-      }
-      if (mode == 0 && load_type == 0) {
-        ocv_input = occ;
-      } else {
-        ocv_input = ocv;
-      }
-      std::thread th_sweep(
-          sweep_ivp, &it8512, &psw, set_current, set_voltage_input, ocv_input,
-          step, step_time, &mode, &progress, &time_ivp, &voltage_ivp,
-          &current_ivp, &power_ivp, &hydrogen_ivp, temperature, fuel_flow,
-          air_flow, load_type, sweep_type, repeat, &str_filename, &stop);
-      th_sweep.detach();
-    }
-    ImGui::SameLine();
-    if (ImGui::Button("停止")) {
-      stop = true;
-      progress = 0.0f;
-    }
-    // ImGui::PushStyleColor(ImGuiCol_FrameBg,
-    //                       (ImVec4)ImColor::ImColor(252, 252, 252, 256));
-    ImGui::PushStyleColor(ImGuiCol_PlotHistogram,
-                          ImVec4(0.10, 0.45, 0.91, 1.00));
-    ImGui::ProgressBar(progress, ImVec2(0.0f, 0.0f));
-    ImGui::PopStyleColor();
-
-    ImGui::End();
-
-    ImGui::Begin("测试结果");
-    float smallest_c_ivp = 0;
-    float biggest_c_ivp = 10;
-    if (current_ivp.size() > 0) {
-      smallest_c_ivp =
-          *std::min_element(current_ivp.begin(), current_ivp.end()) - 0.03;
-      biggest_c_ivp =
-          *std::max_element(current_ivp.begin(), current_ivp.end()) + 0.03;
-    }
-    float smallest_v_ivp = 0;
-    float biggest_v_ivp = 35;
-    if (voltage_ivp.size() > 0) {
-      smallest_v_ivp =
-          *std::min_element(voltage_ivp.begin(), voltage_ivp.end()) - 0.03;
-      biggest_v_ivp =
-          *std::max_element(voltage_ivp.begin(), voltage_ivp.end()) + 0.03;
-    }
-    float smallest_p_ivp = 0;
-    float biggest_p_ivp = 150;
-    if (power_ivp.size() > 0) {
-      smallest_p_ivp =
-          *std::min_element(power_ivp.begin(), power_ivp.end()) - 0.03;
-      biggest_p_ivp =
-          *std::max_element(power_ivp.begin(), power_ivp.end()) + 0.03;
-    }
-    ImPlot::SetNextPlotLimits(smallest_c_ivp, biggest_c_ivp, smallest_v_ivp,
-                              biggest_v_ivp, ImGuiCond_Always);
-    ImPlot::SetNextPlotLimitsY(smallest_p_ivp, biggest_p_ivp, ImGuiCond_Always,
-                               1);
-    if (ImPlot::BeginPlot("IVP曲线", "电流 (A)", "电压 (V)", ImVec2(-1, -1),
-                          ImPlotFlags_NoTitle | ImPlotFlags_YAxis2,
-                          ImPlotAxisFlags_AutoFit, ImPlotAxisFlags_AutoFit,
-                          ImPlotAxisFlags_NoGridLines,
-                          ImPlotAxisFlags_NoGridLines, "功率 (W)")) {
-      ImPlot::PlotLine("电压", current_ivp.data(), voltage_ivp.data(),
-                       current_ivp.size());
-      ImPlot::SetPlotYAxis(ImPlotYAxis_2);
-      ImPlot::PlotLine("功率", current_ivp.data(), power_ivp.data(),
-                       current_ivp.size());
-      ImPlot::EndPlot();
-    }
-    ImGui::End();
-
-    // ImGui::ShowDemoWindow();
-    // ImPlot::ShowDemoWindow();
-    ImGui::Begin("电压");
-    ImPlot::SetNextPlotLimits(0, last_time, smallest_v, biggest_v,
-                              ImGuiCond_Always);
-    if (ImPlot::BeginPlot("电压", "时间 (s)", "电压 (V)", ImVec2(-1, -1),
-                          ImPlotFlags_NoTitle | ImPlotFlags_NoLegend,
-                          ImPlotAxisFlags_None, ImPlotAxisFlags_None)) {
-      ImPlot::PushStyleColor(ImPlotCol_Line, ImPlot::GetColormapColor(0));
-      ImPlot::PlotLine("电压", time.data(), voltage.data(), time.size());
-      ImPlot::PopStyleColor();
-      ImPlot::EndPlot();
-    }
-    ImGui::End();
-
-    ImGui::Begin("电流");
-
-    ImPlot::SetNextPlotLimits(0, last_time, smallest_c, biggest_c,
-                              ImGuiCond_Always);
-    if (ImPlot::BeginPlot("电流", "时间 (s)", "电流 (A)", ImVec2(-1, -1),
-                          ImPlotFlags_NoTitle | ImPlotFlags_NoLegend,
-                          ImPlotAxisFlags_None, ImPlotAxisFlags_None)) {
-      ImPlot::PushStyleColor(ImPlotCol_Line, ImPlot::GetColormapColor(4));
-      ImPlot::PlotLine("电流", time.data(), current.data(), time.size());
-      ImPlot::PopStyleColor();
-      ImPlot::EndPlot();
-    }
-    ImGui::End();
-
-    ImGui::Begin("功率");
-    ImPlot::SetNextPlotLimits(0, last_time, smallest_p, biggest_p,
-                              ImGuiCond_Always);
-    if (ImPlot::BeginPlot("功率", "时间 (s)", "功率 (W)", ImVec2(-1, -1),
-                          ImPlotFlags_NoTitle | ImPlotFlags_NoLegend,
-                          ImPlotAxisFlags_None, ImPlotAxisFlags_None)) {
-      ImPlot::PushStyleColor(ImPlotCol_Line, ImPlot::GetColormapColor(1));
-      ImPlot::PlotLine("功率", time.data(), power.data(), time.size());
-      ImPlot::PopStyleColor();
-      ImPlot::EndPlot();
-    }
-    ImGui::End();
-
-    if (mode == 1) {
-      ImGui::Begin("产氢率");
-
-      ImPlot::SetNextPlotLimits(0, last_time, smallest_h, biggest_h,
-                                ImGuiCond_Always);
-      if (ImPlot::BeginPlot("产氢率", "时间 (s)", "产氢率 (NL/h)",
-                            ImVec2(-1, -1),
-                            ImPlotFlags_NoTitle | ImPlotFlags_NoLegend,
-                            ImPlotAxisFlags_None, ImPlotAxisFlags_None)) {
-        ImPlot::PushStyleColor(ImPlotCol_Line, ImPlot::GetColormapColor(2));
-        ImPlot::PlotLine("产氢率", time.data(), hydrogen.data(), time.size());
-        ImPlot::PopStyleColor();
-        ImPlot::EndPlot();
+      for (std::unique_ptr<station>& st : stations) {
+        const it8512parser::counters link = st->it8512.linkStats();
+        ImGui::Text("%s负载通信: 帧 %llu 损坏 %llu 恢复 %llu 超时 %llu",
+                    st->label.c_str(), link.frames, link.corrupted,
+                    link.recovered, link.timeouts);
+        const samplelog::counters log = st->logger.stats();
+        ImGui::Text("%s日志: 队列 %zu (最大 %zu) 写盘 %.2f ms (最大 %.2f ms) "
+                    "已写 %llu 行",
+                    st->label.c_str(), log.depth, log.max_depth, log.write_ms,
+                    log.max_write_ms, log.written);
+        // Complete blocks only; the run keeps logging while it is exported.
+        ImGui::SameLine();
+        ImGui::PushID(st.get());
+        if (ImGui::Button("导出 CSV")) {
+          const std::string base = st->data_path;
+          std::thread([base]() {
+            runlog::exportCsv(base, base + ".csv");
+          }).detach();
+        }
+        ImGui::PopID();
       }
       ImGui::End();
     }
@@ -1196,8 +1671,15 @@ int main(int, char**) {
   }
 
   // Cleanup
+  // Sweeps hold pointers into their stations: stop them all and wait for
+  // them to unwind before the stations are destroyed.
+  for (const std::unique_ptr<station>& st : stations) {
+    st->stop.request();
+  }
+  executor.wake();
+  executor.drain();
+  stations.clear();
   ImPlot::PopColormap();
-  fclose(fp);
   err = vkDeviceWaitIdle(g_Device);
   check_vk_result(err);
   ImGui_ImplVulkan_Shutdown();
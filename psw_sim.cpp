@@ -0,0 +1,401 @@
+﻿// SCPI power-supply simulator. Listens on a TCP port (and optionally a
+// pseudo-terminal) and answers the commands visalib sends, backed by
+// cellmodel in electrolysis operation, so SCPI round trips can be measured
+// without NI-VISA or a physical supply.
+//
+//   ./psw_sim --port 5025 [--link /tmp/ttyPSW] [--latency-ms 2]
+//
+// then open "TCPIP0::127.0.0.1::5025::SOCKET" or "/tmp/ttyPSW" with visalib.
+// Voltage lists (LIST:VOLT, LIST:DWEL, LIST:COUN, VOLT:MODE LIST, INIT and a
+// bus trigger) run on the simulator's clock.
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cellmodel.hpp"
+
+typedef std::chrono::steady_clock sim_clock;
+
+class pswsim {
+ public:
+  explicit pswsim(const cellmodel& model)
+      : cell(model), last_update(sim_clock::now()) {}
+
+  // Executes one line, which may hold several ';'-separated commands, and
+  // returns the query responses joined by ';' (empty if there were none).
+  std::string execute(const std::string& line) {
+    update();
+    std::string response;
+    size_t begin = 0;
+    while (begin <= line.size()) {
+      size_t end = line.find(';', begin);
+      if (end == std::string::npos) {
+        end = line.size();
+      }
+      std::string result;
+      if (command(line.substr(begin, end - begin), result)) {
+        if (!response.empty()) {
+          response += ';';
+        }
+        response += result;
+      }
+      begin = end + 1;
+    }
+    return response;
+  }
+
+ private:
+  static std::string upper(const std::string& s) {
+    std::string out = s;
+    std::transform(out.begin(), out.end(), out.begin(),
+                   [](unsigned char c) { return (char)std::toupper(c); });
+    return out;
+  }
+
+  static std::string trim(const std::string& s) {
+    size_t b = s.find_first_not_of(" \t\r\n:");
+    size_t e = s.find_last_not_of(" \t\r\n");
+    return b == std::string::npos ? std::string() : s.substr(b, e - b + 1);
+  }
+
+  static std::vector<double> numbers(const std::string& arg) {
+    std::vector<double> values;
+    size_t begin = 0;
+    while (begin < arg.size()) {
+      size_t end = arg.find(',', begin);
+      if (end == std::string::npos) {
+        end = arg.size();
+      }
+      values.push_back(atof(arg.substr(begin, end - begin).c_str()));
+      begin = end + 1;
+    }
+    return values;
+  }
+
+  void startList() {
+    initiated = false;
+    list_running = true;
+    list_started = true;
+    list_index = 0;
+    list_pass = 0;
+    list_elapsed = 0.0;
+  }
+
+  static std::string number(double value) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.4f", value);
+    return buf;
+  }
+
+  // Returns true and fills result for queries.
+  bool command(const std::string& text, std::string& result) {
+    const std::string cmd = trim(text);
+    if (cmd.empty()) {
+      return false;
+    }
+    const size_t space = cmd.find(' ');
+    const std::string header = upper(cmd.substr(0, space));
+    const std::string arg =
+        space == std::string::npos ? std::string() : trim(cmd.substr(space));
+    if (header == "*IDN?") {
+      result = "SIM,PSW-SIM,0,1.0";
+    } else if (header == "*CLS") {
+      error.clear();
+    } else if (header == "*OPC?") {
+      result = "1";
+    } else if (header == "LIST:VOLT") {
+      list_voltage = numbers(arg);
+    } else if (header == "LIST:DWEL") {
+      list_dwell = numbers(arg);
+    } else if (header == "LIST:COUN") {
+      list_count = upper(arg) == "INF" ? 0 : atoi(arg.c_str());
+    } else if (header == "VOLT:MODE") {
+      list_mode = upper(arg) == "LIST";
+      list_running = false;
+      list_started = false;
+    } else if (header == "TRIG:SOUR") {
+      trigger_bus = upper(arg) == "BUS";
+    } else if (header == "INIT") {
+      if (!list_mode || list_voltage.empty() ||
+          (list_dwell.size() != 1 &&
+           list_dwell.size() != list_voltage.size())) {
+        error = "-221,\"Settings conflict\"";
+      } else {
+        initiated = true;
+        if (!trigger_bus) {
+          startList();
+        }
+      }
+    } else if (header == "*TRG") {
+      if (initiated && trigger_bus) {
+        startList();
+      }
+    } else if (header == "ABOR") {
+      initiated = false;
+      list_running = false;
+    } else if (header == "*RST") {
+      set_voltage = 0.0;
+      output_on = false;
+      armed = false;
+    } else if (header == "OUTP:TRIG") {
+      armed = arg == "1" || upper(arg) == "ON";
+    } else if (header == "INIT:NAME") {
+      output_on = armed;
+    } else if (header == "OUTP" || header == "OUTP:STAT") {
+      output_on = arg == "1" || upper(arg) == "ON";
+    } else if (header == "OUTP?" || header == "OUTP:STAT?") {
+      result = output_on ? "1" : "0";
+    } else if (header == "SOUR:VOLT:LEV:IMM:AMPL" || header == "SOUR:VOLT" ||
+               header == "VOLT") {
+      set_voltage = atof(arg.c_str());
+    } else if (header == "SOUR:VOLT?" || header == "VOLT?") {
+      result = number(set_voltage);
+    } else if (header == "MEAS:VOLT:DC?" || header == "MEAS:VOLT?") {
+      result = number(voltage);
+    } else if (header == "MEAS:CURR:DC?" || header == "MEAS:CURR?") {
+      result = number(current);
+    } else if (header == "SYST:ERR?") {
+      result = error.empty() ? "0,\"No error\"" : error;
+      error.clear();
+    } else {
+      error = "-113,\"Undefined header\"";
+    }
+    return !result.empty();
+  }
+
+  // Advances the model to the present. A running list changes voltage at
+  // its step boundaries, so each piece runs with the voltage active then; a
+  // finished list holds its last step.
+  void update() {
+    const sim_clock::time_point t = sim_clock::now();
+    double dt = std::chrono::duration<double>(t - last_update).count();
+    last_update = t;
+    while (list_running && dt > 0.0) {
+      const double dwell = list_dwell.size() == 1 ? list_dwell[0]
+                                                  : list_dwell[list_index];
+      const double length = dwell > 0.0001 ? dwell : 0.0001;
+      const double piece =
+          length - list_elapsed < dt ? length - list_elapsed : dt;
+      run(list_voltage[list_index], piece);
+      dt -= piece;
+      list_elapsed += piece;
+      if (list_elapsed >= length) {
+        list_elapsed = 0.0;
+        if (list_index + 1 < list_voltage.size()) {
+          list_index++;
+        } else if (list_count == 0 || ++list_pass < list_count) {
+          list_index = 0;
+        } else {
+          list_running = false;
+        }
+      }
+    }
+    if (dt > 0.0) {
+      run(list_mode && list_started ? list_voltage[list_index] : set_voltage,
+          dt);
+    }
+  }
+
+  // The supply can only source current: below the stack's open-circuit
+  // voltage it delivers nothing and the terminals show the stack voltage.
+  void run(double setpoint, double dt) {
+    const double ocv = cell.parameters().steadyVoltage(0.0);
+    if (output_on && setpoint > ocv) {
+      current = -cell.holdVoltage(setpoint, dt);
+      voltage = setpoint;
+    } else {
+      voltage = cell.drawCurrent(0.0, dt);
+      current = 0.0;
+    }
+  }
+
+  cellstate cell;
+  sim_clock::time_point last_update;
+  bool armed = false;
+  bool output_on = false;
+  double set_voltage = 0.0;
+  double voltage = 0.0;
+  double current = 0.0;
+  std::string error;
+  std::vector<double> list_voltage;
+  std::vector<double> list_dwell;
+  int list_count = 1;  // 0 repeats forever
+  bool list_mode = false;
+  bool trigger_bus = false;
+  bool initiated = false;
+  bool list_running = false;
+  bool list_started = false;
+  size_t list_index = 0;
+  int list_pass = 0;
+  double list_elapsed = 0.0;
+};
+
+struct client {
+  int fd;
+  std::string buffer;
+};
+
+static void usage() {
+  printf(
+      "usage: psw_sim [--port N] [--link PATH] [--latency-ms MS]\n"
+      "               [--cells N] [--e0 V] [--tafel V] [--i0 A] [--r OHM]\n"
+      "               [--b V] [--il A] [--tau S] [--noise V]\n");
+}
+
+static int open_pty(const std::string& link) {
+  const int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+    perror("posix_openpt");
+    return -1;
+  }
+  const char* slave = ptsname(master);
+  const int slave_fd = open(slave, O_RDWR | O_NOCTTY);
+  termios tty;
+  tcgetattr(slave_fd, &tty);
+  cfmakeraw(&tty);
+  tcsetattr(slave_fd, TCSANOW, &tty);
+  unlink(link.c_str());
+  if (symlink(slave, link.c_str()) != 0) {
+    perror("symlink");
+    return -1;
+  }
+  printf("SCPI supply simulator on %s -> %s\n", slave, link.c_str());
+  return master;
+}
+
+int main(int argc, char** argv) {
+  cellmodel model;
+  int port = 5025;
+  std::string link;
+  double latency_ms = 0.0;
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+    if (value == NULL) {
+      usage();
+      return 1;
+    }
+    if (!strcmp(arg, "--port")) {
+      port = atoi(value);
+    } else if (!strcmp(arg, "--link")) {
+      link = value;
+    } else if (!strcmp(arg, "--latency-ms")) {
+      latency_ms = atof(value);
+    } else if (!strcmp(arg, "--cells")) {
+      model.cells = atoi(value);
+    } else if (!strcmp(arg, "--e0")) {
+      model.e0 = atof(value);
+    } else if (!strcmp(arg, "--tafel")) {
+      model.tafel = atof(value);
+    } else if (!strcmp(arg, "--i0")) {
+      model.i0 = atof(value);
+    } else if (!strcmp(arg, "--r")) {
+      model.r = atof(value);
+    } else if (!strcmp(arg, "--b")) {
+      model.b = atof(value);
+    } else if (!strcmp(arg, "--il")) {
+      model.il = atof(value);
+    } else if (!strcmp(arg, "--tau")) {
+      model.tau = atof(value);
+    } else if (!strcmp(arg, "--noise")) {
+      model.noise = atof(value);
+    } else {
+      usage();
+      return 1;
+    }
+    i++;
+  }
+
+  const int listener = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if (bind(listener, (sockaddr*)&addr, sizeof(addr)) != 0 ||
+      listen(listener, 8) != 0) {
+    perror("bind");
+    return 1;
+  }
+  printf("SCPI supply simulator on TCPIP0::127.0.0.1::%d::SOCKET\n", port);
+
+  std::vector<client> clients;
+  if (!link.empty()) {
+    const int master = open_pty(link);
+    if (master < 0) {
+      return 1;
+    }
+    clients.push_back(client{master, std::string()});
+  }
+  fflush(stdout);
+
+  pswsim sim(model);
+  while (true) {
+    std::vector<pollfd> fds;
+    fds.push_back(pollfd{listener, POLLIN, 0});
+    for (size_t i = 0; i < clients.size(); i++) {
+      fds.push_back(pollfd{clients[i].fd, POLLIN, 0});
+    }
+    if (poll(fds.data(), fds.size(), -1) <= 0) {
+      continue;
+    }
+    if (fds[0].revents & POLLIN) {
+      const int fd = accept(listener, NULL, NULL);
+      if (fd >= 0) {
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        clients.push_back(client{fd, std::string()});
+      }
+    }
+    for (size_t i = 1; i < fds.size(); i++) {
+      if (!(fds[i].revents & (POLLIN | POLLHUP))) {
+        continue;
+      }
+      client& c = clients[i - 1];
+      char chunk[512];
+      const ssize_t n = read(c.fd, chunk, sizeof(chunk));
+      if (n <= 0) {
+        // Drop sockets on EOF; the pty is never closed.
+        if (c.fd != fds[1].fd || link.empty()) {
+          close(c.fd);
+          c.fd = -1;
+        }
+        continue;
+      }
+      c.buffer.append(chunk, n);
+      size_t eol;
+      while ((eol = c.buffer.find('\n')) != std::string::npos) {
+        const std::string response = sim.execute(c.buffer.substr(0, eol));
+        c.buffer.erase(0, eol + 1);
+        if (response.empty()) {
+          continue;
+        }
+        if (latency_ms > 0.0) {
+          std::this_thread::sleep_for(
+              std::chrono::duration<double, std::milli>(latency_ms));
+        }
+        const std::string line = response + "\n";
+        if (write(c.fd, line.data(), line.size()) < 0) {
+          perror("write");
+        }
+      }
+    }
+    clients.erase(std::remove_if(clients.begin(), clients.end(),
+                                 [](const client& c) { return c.fd < 0; }),
+                  clients.end());
+  }
+}
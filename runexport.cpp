@@ -0,0 +1,52 @@
+﻿// Exports a binary run file (*_t.run) or a segmented run through its index
+// (data*.idx) to the sample-log CSV, or lists the blocks of a run file.
+//
+//   runexport data.idx [out.csv] [begin end]
+//   runexport sweep_t.run [out.csv] [begin end]
+//   runexport --blocks data.000.run
+//
+// Without out.csv the CSV is written next to the input. `begin` and `end`
+// are seconds on the run's clock; blocks outside them are not read.
+#include <stdlib.h>
+#include <string.h>
+
+#include <iostream>
+#include <string>
+
+#include "runfile.hpp"
+#include "runlog.hpp"
+
+int main(int argc, char** argv) {
+  if (argc >= 3 && strcmp(argv[1], "--blocks") == 0) {
+    runreader reader;
+    if (!reader.open(argv[2])) {
+      return 1;
+    }
+    const runheader& h = reader.header();
+    printf("mode %d load_type %d sweep_type %d temperature %.1f fuel %.3f "
+           "air %.3f\n",
+           h.mode, h.load_type, h.sweep_type, h.temperature, h.fuel_flow,
+           h.air_flow);
+    for (const runblock& b : reader.blocks()) {
+      printf("%u rows %.4f-%.4f V %.2f-%.2f I %.3f-%.3f mode %d\n", b.count,
+             b.time_min, b.time_max, b.min[0], b.max[0], b.min[1], b.max[1],
+             b.mode);
+    }
+    return 0;
+  }
+  if (argc != 2 && argc != 3 && argc != 5) {
+    std::cout << "用法: runexport data.idx|data.run [out.csv] [begin end]"
+              << std::endl;
+    std::cout << "      runexport --blocks data.run" << std::endl;
+    return 1;
+  }
+  const std::string input = argv[1];
+  const std::string stem = input.substr(0, input.size() - 4);
+  const std::string csv = argc >= 3 ? std::string(argv[2]) : stem + ".csv";
+  const double begin = argc == 5 ? atof(argv[3]) : -1e300;
+  const double end = argc == 5 ? atof(argv[4]) : 1e300;
+  if (input.size() > 4 && input.compare(input.size() - 4, 4, ".idx") == 0) {
+    return runlog::exportCsv(stem, csv, begin, end) ? 0 : 1;
+  }
+  return exportCsv(input, csv, begin, end) ? 0 : 1;
+}
@@ -0,0 +1,20 @@
+﻿#pragma once
+#include <stdio.h>
+
+// Minimal checks for the unit tests: a failed check prints where it failed
+// and counts towards the test's exit code, and the test carries on.
+static int failures = 0;
+
+#define CHECK(condition)                                                 \
+  do {                                                                   \
+    if (!(condition)) {                                                  \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+      failures++;                                                        \
+    }                                                                    \
+  } while (0)
+
+// Prints the verdict; main returns it.
+static int report(const char* test) {
+  printf("%s: %s\n", test, failures == 0 ? "OK" : "FAILED");
+  return failures == 0 ? 0 : 1;
+}
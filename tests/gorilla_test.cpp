@@ -0,0 +1,131 @@
+﻿#include <math.h>
+#include <string.h>
+
+#include <limits>
+#include <vector>
+
+#include "check.hpp"
+#include "gorilla.hpp"
+
+namespace {
+bool roundTrip(const std::vector<int64_t>& values) {
+  gorillatimes out;
+  for (int64_t v : values) {
+    out.add(v);
+  }
+  std::vector<int64_t> back(values.size());
+  if (!gorillatimes::decode(out.bytes().data(), out.bytes().size(),
+                            (uint32_t)values.size(), back.data())) {
+    return false;
+  }
+  return back == values;
+}
+
+// Bit-exact, so NaN payloads and -0 must survive too.
+bool roundTrip(const std::vector<float>& values) {
+  gorillafloats out;
+  for (float v : values) {
+    out.add(v);
+  }
+  std::vector<float> back(values.size());
+  if (!gorillafloats::decode(out.bytes().data(), out.bytes().size(),
+                             (uint32_t)values.size(), back.data())) {
+    return false;
+  }
+  return memcmp(back.data(), values.data(), values.size() * sizeof(float)) ==
+         0;
+}
+
+void times() {
+  std::vector<int64_t> steady;
+  for (int64_t k = 0; k < 4096; k++) {
+    steady.push_back(1700000000000000ll + k * 40000);
+  }
+  CHECK(roundTrip(steady));
+  // A steady rate costs about a bit per sample.
+  gorillatimes out;
+  for (int64_t t : steady) {
+    out.add(t);
+  }
+  CHECK(out.bytes().size() < steady.size() / 4);
+
+  std::vector<int64_t> jitter;
+  int64_t t = 0;
+  for (int k = 0; k < 1000; k++) {
+    t += 40000 + (k * 7919) % 2001 - 1000;
+    jitter.push_back(t);
+  }
+  CHECK(roundTrip(jitter));
+
+  // Pauses, a clock step back and deltas of every size class.
+  CHECK(roundTrip(std::vector<int64_t>{0, 1, 2, 3, 100, 99, 5000000, 5000000,
+                                       -3, 1ll << 40, (1ll << 40) + 1,
+                                       std::numeric_limits<int32_t>::max(),
+                                       0}));
+  CHECK(roundTrip(std::vector<int64_t>{42}));
+  CHECK(roundTrip(std::vector<int64_t>{}));
+}
+
+void floats() {
+  std::vector<float> slow;
+  for (int k = 0; k < 4096; k++) {
+    slow.push_back(24.0f + 0.001f * (k % 50));
+  }
+  CHECK(roundTrip(slow));
+
+  CHECK(roundTrip(std::vector<float>(1000, 12.5f)));
+  gorillafloats repeated;
+  for (int k = 0; k < 1000; k++) {
+    repeated.add(12.5f);
+  }
+  CHECK(repeated.bytes().size() < 140);
+
+  CHECK(roundTrip(std::vector<float>{
+      0.0f, -0.0f, 1.0f, -1.0f, std::numeric_limits<float>::max(),
+      std::numeric_limits<float>::denorm_min(),
+      std::numeric_limits<float>::infinity(),
+      -std::numeric_limits<float>::infinity(), NAN, 3.14159f, 3.14159f,
+      1e-30f, 1e30f, 0.0f}));
+  CHECK(roundTrip(std::vector<float>{7.0f}));
+}
+
+// A cut-off stream is reported instead of decoded into garbage.
+void truncated() {
+  gorillafloats out;
+  for (int k = 0; k < 100; k++) {
+    out.add(0.37f * k);
+  }
+  std::vector<float> back(100);
+  CHECK(!gorillafloats::decode(out.bytes().data(), out.bytes().size() / 2,
+                               100, back.data()));
+  gorillatimes ticks;
+  for (int k = 0; k < 100; k++) {
+    ticks.add((int64_t)k * k * 1000);
+  }
+  std::vector<int64_t> t(100);
+  CHECK(!gorillatimes::decode(ticks.bytes().data(), ticks.bytes().size() / 2,
+                              100, t.data()));
+}
+
+// clear() starts a new stream, as the run writer does for each block.
+void reuse() {
+  gorillafloats out;
+  out.add(1.0f);
+  out.add(2.0f);
+  out.clear();
+  out.add(5.0f);
+  out.add(5.5f);
+  float back[2];
+  CHECK(gorillafloats::decode(out.bytes().data(), out.bytes().size(), 2,
+                              back));
+  CHECK(back[0] == 5.0f && back[1] == 5.5f);
+}
+}  // namespace
+
+int main() {
+  times();
+  floats();
+  truncated();
+  reuse();
+  return report("gorilla_test");
+}
@@ -0,0 +1,88 @@
+﻿#include <algorithm>
+#include <vector>
+
+#include "cellmodel.hpp"
+#include "check.hpp"
+#include "ivrefine.hpp"
+
+namespace {
+// A coarse fuel-cell sweep of the simulators' stack, 0 to 19 A.
+void curve(std::vector<float>& x, std::vector<float>& y) {
+  const cellmodel stack;
+  for (int i = 0; i < 20; i++) {
+    x.push_back((float)i);
+    y.push_back((float)stack.steadyVoltage(i));
+  }
+}
+
+// The extra points go to the activation and mass-transport knees, between
+// existing points, and the ohmic middle is left alone.
+void knees() {
+  std::vector<float> x;
+  std::vector<float> y;
+  curve(x, y);
+  const std::vector<float> extra = refineSetpoints(x, y, 4);
+  CHECK(!extra.empty() && extra.size() <= 4);
+  CHECK(std::is_sorted(extra.begin(), extra.end()));
+  CHECK(std::adjacent_find(extra.begin(), extra.end()) == extra.end());
+  for (float e : extra) {
+    CHECK(std::find(x.begin(), x.end(), e) == x.end());
+    CHECK(e < 3.0f || e > 16.0f);
+  }
+  CHECK(!extra.empty() && extra.front() < 3.0f && extra.back() > 16.0f);
+}
+
+// Refining again, as the sweep does after each pass, keeps to the budget
+// and keeps working on the knees.
+void passes() {
+  std::vector<float> x;
+  std::vector<float> y;
+  curve(x, y);
+  const cellmodel stack;
+  int budget = 12;
+  while (budget > 0) {
+    const std::vector<float> extra = refineSetpoints(x, y, budget);
+    if (extra.empty()) {
+      break;
+    }
+    CHECK((int)extra.size() <= budget);
+    for (float e : extra) {
+      const size_t at = std::upper_bound(x.begin(), x.end(), e) - x.begin();
+      x.insert(x.begin() + at, e);
+      y.insert(y.begin() + at, (float)stack.steadyVoltage(e));
+    }
+    budget -= (int)extra.size();
+  }
+  CHECK(x.size() <= 32);
+  const int middle = (int)std::count_if(
+      x.begin(), x.end(), [](float v) { return v > 5.0f && v < 15.0f; });
+  CHECK(middle == 9);
+}
+
+void nothingToRefine() {
+  std::vector<float> x;
+  std::vector<float> line;
+  std::vector<float> flat;
+  for (int i = 0; i < 10; i++) {
+    x.push_back((float)i);
+    line.push_back(30.0f - 0.5f * i);
+    flat.push_back(24.0f);
+  }
+  CHECK(refineSetpoints(x, line, 5).empty());
+  CHECK(refineSetpoints(x, flat, 5).empty());
+  x.clear();
+  std::vector<float> y;
+  curve(x, y);
+  CHECK(refineSetpoints(x, y, 0).empty());
+  CHECK(refineSetpoints(std::vector<float>(x.begin(), x.begin() + 2),
+                        std::vector<float>(y.begin(), y.begin() + 2), 5)
+            .empty());
+}
+}  // namespace
+
+int main() {
+  knees();
+  passes();
+  nothingToRefine();
+  return report("ivrefine_test");
+}
@@ -0,0 +1,129 @@
+﻿#include <string.h>
+
+#include <vector>
+
+#include "check.hpp"
+#include "it8512parser.hpp"
+
+namespace {
+const it8512codec::frame vcp = it8512codec::fixed<it8512codec::READ_VCP>::value;
+const it8512codec::frame set = it8512codec::current(1.5f);
+
+// Feeds `bytes` one at a time, as a slow line would deliver them.
+void trickle(it8512parser& p, const std::vector<unsigned char>& bytes) {
+  for (unsigned char b : bytes) {
+    p.feed(&b, 1);
+  }
+}
+
+std::vector<unsigned char> bytes(const it8512codec::frame& f,
+                                 size_t count = 26) {
+  return std::vector<unsigned char>(f.begin(), f.begin() + count);
+}
+
+void cleanFrames() {
+  it8512parser p;
+  std::vector<unsigned char> line = bytes(vcp);
+  const std::vector<unsigned char> second = bytes(set);
+  line.insert(line.end(), second.begin(), second.end());
+  trickle(p, line);
+  it8512codec::frame f;
+  CHECK(p.next(f) && f == vcp);
+  CHECK(p.next(f) && f == set);
+  CHECK(!p.next(f));
+  const it8512parser::counters c = p.stats();
+  CHECK(c.frames == 2 && c.corrupted == 0 && c.discarded == 0);
+  CHECK(c.recovered == 0);
+}
+
+// A frame cut short on the wire, then a whole one: only the whole one comes
+// out, and the parser counts the loss and the recovery.
+void truncatedFrame() {
+  it8512parser p;
+  std::vector<unsigned char> line = bytes(set, 10);
+  const std::vector<unsigned char> whole = bytes(vcp);
+  line.insert(line.end(), whole.begin(), whole.end());
+  p.feed(line.data(), (unsigned int)line.size());
+  it8512codec::frame f;
+  CHECK(p.next(f) && f == vcp);
+  CHECK(!p.next(f));
+  const it8512parser::counters c = p.stats();
+  CHECK(c.frames == 1);
+  CHECK(c.corrupted + c.discarded > 0);
+  CHECK(c.recovered == 1);
+  CHECK(p.buffered() == 0);
+}
+
+// A truncated frame with nothing after it is dropped when the read times
+// out, so the next reply starts clean.
+void truncatedAtTimeout() {
+  it8512parser p;
+  const std::vector<unsigned char> part = bytes(set, 12);
+  p.feed(part.data(), (unsigned int)part.size());
+  CHECK(p.buffered() == 12);
+  CHECK(p.needed() == 14);
+  p.countTimeout();
+  CHECK(p.buffered() == 0);
+  trickle(p, bytes(vcp));
+  it8512codec::frame f;
+  CHECK(p.next(f) && f == vcp);
+  const it8512parser::counters c = p.stats();
+  CHECK(c.timeouts == 1 && c.discarded == 12 && c.recovered == 1);
+}
+
+void badChecksum() {
+  it8512parser p;
+  it8512codec::frame damaged = set;
+  damaged[25] ^= 0x01;
+  std::vector<unsigned char> line = bytes(damaged);
+  const std::vector<unsigned char> whole = bytes(vcp);
+  line.insert(line.end(), whole.begin(), whole.end());
+  trickle(p, line);
+  it8512codec::frame f;
+  CHECK(p.next(f) && f == vcp);
+  CHECK(!p.next(f));
+  const it8512parser::counters c = p.stats();
+  CHECK(c.frames == 1 && c.corrupted >= 1 && c.recovered == 1);
+}
+
+// A payload byte equal to the header must not be taken for a frame start.
+void headerInPayload() {
+  it8512parser p;
+  const it8512codec::frame f0 = it8512codec::make(it8512codec::SET_CURRENT,
+                                                  it8512codec::header);
+  std::vector<unsigned char> line(3, 0x55);
+  const std::vector<unsigned char> whole = bytes(f0);
+  line.insert(line.end(), whole.begin(), whole.end());
+  p.feed(line.data(), (unsigned int)line.size());
+  it8512codec::frame f;
+  CHECK(p.next(f) && f == f0);
+  CHECK(p.stats().discarded == 3);
+}
+
+void replyMatching() {
+  it8512parser p;
+  const it8512codec::frame status =
+      it8512codec::make(it8512codec::STATUS, it8512codec::OK);
+  std::vector<unsigned char> line = bytes(vcp);
+  const std::vector<unsigned char> second = bytes(status);
+  line.insert(line.end(), second.begin(), second.end());
+  p.feed(line.data(), (unsigned int)line.size());
+  // The READ_VCP frame is a late reply nobody waits for any more.
+  it8512codec::frame f;
+  CHECK(p.reply(it8512codec::SET_CURRENT, f) && f == status);
+  CHECK(p.stats().stale == 1);
+  CHECK(it8512codec::answers(vcp, it8512codec::READ_VCP));
+  CHECK(it8512codec::answers(status, it8512codec::READ_VCP));
+  CHECK(!it8512codec::answers(vcp, it8512codec::SET_CURRENT));
+}
+}  // namespace
+
+int main() {
+  cleanFrames();
+  truncatedFrame();
+  truncatedAtTimeout();
+  badChecksum();
+  headerInPayload();
+  replyMatching();
+  return report("parser_test");
+}
@@ -0,0 +1,86 @@
+﻿#include <sstream>
+#include <string>
+
+#include "check.hpp"
+#include "recipe.hpp"
+
+namespace {
+bool compiles(const std::string& text, recipe& r) {
+  std::istringstream in(text);
+  return r.compile(in);
+}
+
+bool compiles(const std::string& text) {
+  recipe r;
+  return compiles(text, r);
+}
+
+void program() {
+  recipe r;
+  CHECK(compiles(
+      "# warm-up\n"
+      "mode fc\n"
+      "load cv\n"
+      "ramp 0 2 2 1.5   # 0, 1, 2\n"
+      "repeat 2\n"
+      "  set 5 1\n"
+      "  break_if V < 0.6\n"
+      "  hold 3\n"
+      "end\n"
+      "stop_if I > 10\n"
+      "set 0 1\n",
+      r));
+  const std::vector<recipestep>& s = r.program();
+  CHECK(s.size() == 13);
+  CHECK(s[0].code == recipestep::MODE && s[0].value == 0.0f);
+  CHECK(s[1].code == recipestep::LOAD && s[1].value == 1.0f);
+  CHECK(s[2].code == recipestep::SET && s[2].value == 0.0f &&
+        s[2].seconds == 1.5f);
+  CHECK(s[4].code == recipestep::SET && s[4].value == 2.0f);
+  // Both passes of the loop break to the step after it.
+  CHECK(s[6].code == recipestep::JUMP_IF && s[6].variable == 'V' &&
+        s[6].compare == '<' && s[6].value == 0.6f && s[6].target == 11);
+  CHECK(s[9].code == recipestep::JUMP_IF && s[9].target == 11);
+  CHECK(s[7].code == recipestep::HOLD && s[7].seconds == 3.0f);
+  // stop_if jumps past the end.
+  CHECK(s[11].code == recipestep::JUMP_IF && s[11].target == 13);
+  CHECK(!r.listable());
+
+  CHECK(compiles("switch 0 1 1 2\n", r));
+  CHECK(r.program().size() == 3 && r.listable());
+  CHECK(compiles("", r) && r.program().empty() && !r.listable());
+}
+
+void syntaxErrors() {
+  CHECK(!compiles("jump 3\n"));
+  CHECK(!compiles("set 1\n"));
+  CHECK(!compiles("set 1 2 3\n"));
+  CHECK(!compiles("mode sofc\n"));
+  CHECK(!compiles("load cp\n"));
+  CHECK(!compiles("ramp 0 1 0 1\n"));
+  CHECK(!compiles("repeat 0\nset 1 1\nend\n"));
+  CHECK(!compiles("repeat 2\nset 1 1\n"));
+  CHECK(!compiles("set 1 1\nend\n"));
+  CHECK(!compiles("break_if V < 1\n"));
+  CHECK(!compiles("repeat 2\nbreak_if T < 1\nend\n"));
+  CHECK(!compiles("stop_if V = 1\n"));
+  CHECK(!compiles("stop_if V <\n"));
+  // Comments and blank lines are not errors.
+  CHECK(compiles("\n   # nothing here\n\n"));
+}
+
+// A failed compile leaves no half-built program behind.
+void failureClears() {
+  recipe r;
+  CHECK(compiles("set 1 1\nset 2 1\n", r));
+  CHECK(!compiles("set 3 1\nbogus\n", r));
+  CHECK(r.program().empty());
+}
+}  // namespace
+
+int main() {
+  program();
+  syntaxErrors();
+  failureClears();
+  return report("recipe_test");
+}
@@ -0,0 +1,173 @@
+﻿#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <filesystem>
+#include <string>
+
+#include "check.hpp"
+#include "runfile.hpp"
+
+namespace {
+// 100 Hz samples; the settings change once, at row 5000.
+logrecord sample(int k) {
+  logrecord r = {};
+  r.time = 1000.0 + k * 0.01;
+  r.voltage = 24.0f + 0.001f * (k % 97);
+  r.current = 0.5f * (k / 100);
+  r.power = r.voltage * r.current;
+  r.hydrogen = 0.01f * k;
+  r.mode = k < 5000 ? 0 : 1;
+  r.temperature = 700.0f;
+  r.fuel_flow = 0.5f;
+  r.air_flow = 20.0f;
+  r.load_type = 0;
+  return r;
+}
+
+const int rows = 10000;
+
+bool sameRow(const runcolumns& c, size_t i, const logrecord& r) {
+  return fabs(c.time[i] - r.time) < 1e-6 && c.voltage[i] == r.voltage &&
+         c.current[i] == r.current && c.power[i] == r.power &&
+         c.hydrogen[i] == r.hydrogen;
+}
+
+void writeAndRead(const std::string& path) {
+  runheader header = {};
+  header.mode = 0;
+  header.temperature = 700.0f;
+  {
+    runwriter writer;
+    CHECK(writer.open(path, header));
+    uint32_t written = 0;
+    for (int k = 0; k < rows; k++) {
+      written += writer.add(sample(k));
+    }
+    written += writer.close();
+    CHECK(written == (uint32_t)rows);
+  }
+  runreader reader;
+  CHECK(reader.open(path));
+  CHECK(reader.header().version == 2);
+  CHECK(reader.header().temperature == 700.0f);
+  // Full blocks, and a short one where the mode changed.
+  CHECK(reader.blocks().size() == 4);
+  CHECK(reader.blocks()[0].count == runwriter::block_rows);
+  CHECK(reader.blocks()[1].count == 5000 - runwriter::block_rows);
+  CHECK(reader.blocks()[2].mode == 1);
+
+  runcolumns all;
+  for (size_t i = 0; i < reader.blocks().size(); i++) {
+    CHECK(reader.read(i, all));
+  }
+  CHECK(all.time.size() == (size_t)rows);
+  bool same = all.time.size() == (size_t)rows;
+  for (int k = 0; same && k < rows; k++) {
+    same = sameRow(all, k, sample(k));
+  }
+  CHECK(same);
+
+  const runblock& b = reader.blocks()[0];
+  CHECK(b.time_min == sample(0).time);
+  CHECK(b.time_max == sample(runwriter::block_rows - 1).time);
+  CHECK(b.min[1] == 0.0f);
+  CHECK(b.max[1] == sample(runwriter::block_rows - 1).current);
+
+  // A time range reads only the rows inside it.
+  runcolumns range;
+  CHECK(reader.read(1030.0, 1040.0, range));
+  CHECK(range.time.size() == 1001);
+  CHECK(!range.time.empty() && sameRow(range, 0, sample(3000)));
+}
+
+// A block cut short by a crash is not read, and is dropped when the run
+// continues.
+void tornWrite(const std::string& path) {
+  const long long complete = std::filesystem::file_size(path);
+  FILE* fp = fopen(path.c_str(), "ab");
+  CHECK(fp != NULL);
+  runblock partial = {};
+  partial.count = 100;
+  fwrite(&partial, sizeof(partial), 1, fp);
+  fclose(fp);
+  {
+    runreader reader;
+    CHECK(reader.open(path));
+    CHECK(reader.blocks().size() == 4);
+    CHECK(reader.end() == complete);
+  }
+  {
+    runwriter writer;
+    CHECK(writer.open(path, runheader()));
+    CHECK(writer.size() == complete);
+    for (int k = rows; k < rows + 10; k++) {
+      writer.add(sample(k));
+    }
+  }
+  runreader reader;
+  CHECK(reader.open(path));
+  CHECK(reader.blocks().size() == 5);
+  runcolumns last;
+  CHECK(reader.read(4, last));
+  CHECK(last.time.size() == 10 && sameRow(last, 9, sample(rows + 9)));
+}
+
+// A block whose columns do not decode fails the read and the export, and
+// the CSV ends before it.
+void corruptBlock(const std::string& path, const std::string& csv) {
+  long long offset;
+  {
+    runreader reader;
+    CHECK(reader.open(path));
+    offset = reader.offset(1);
+  }
+  // Moves all but one byte of the time column to the voltage column, so
+  // the block still scans but its times run out.
+  FILE* fp = fopen(path.c_str(), "r+b");
+  CHECK(fp != NULL);
+  uint32_t sizes[5];
+  fseek(fp, (long)(offset + sizeof(runblock)), SEEK_SET);
+  CHECK(fread(sizes, sizeof(sizes), 1, fp) == 1);
+  sizes[1] += sizes[0] - 1;
+  sizes[0] = 1;
+  fseek(fp, (long)(offset + sizeof(runblock)), SEEK_SET);
+  fwrite(sizes, sizeof(sizes), 1, fp);
+  fclose(fp);
+
+  runreader reader;
+  CHECK(reader.open(path));
+  CHECK(reader.blocks().size() == 5);
+  runcolumns out;
+  CHECK(reader.read(0, out));
+  CHECK(!reader.read(1, out));
+  runcolumns range;
+  CHECK(!reader.read(0.0, 1e9, range));
+
+  CHECK(!exportCsv(path, csv));
+  fp = fopen(csv.c_str(), "r");
+  CHECK(fp != NULL);
+  int lines = 0;
+  char line[256];
+  while (fp && fgets(line, sizeof(line), fp)) {
+    lines++;
+  }
+  if (fp) {
+    fclose(fp);
+  }
+  CHECK(lines == 1 + (int)runwriter::block_rows);
+}
+}  // namespace
+
+int main() {
+  const std::filesystem::path dir =
+      std::filesystem::temp_directory_path() / "runfile_test";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  const std::string path = (dir / "run.run").string();
+  writeAndRead(path);
+  tornWrite(path);
+  corruptBlock(path, (dir / "run.csv").string());
+  std::filesystem::remove_all(dir);
+  return report("runfile_test");
+}
@@ -0,0 +1,139 @@
+﻿#include <math.h>
+#include <stdio.h>
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "check.hpp"
+#include "runlog.hpp"
+
+namespace {
+// One sample a second for two and a half hours: three segments.
+const int rows = 9000;
+
+logrecord sample(int k) {
+  logrecord r = {};
+  r.time = 100.0 + k;
+  r.voltage = 20.0f + 0.01f * (k % 300);
+  r.current = 0.1f * (k % 50);
+  r.power = r.voltage * r.current;
+  r.temperature = 700.0f;
+  r.air_flow = 20.0f;
+  return r;
+}
+
+int countLines(const std::string& path) {
+  FILE* fp = fopen(path.c_str(), "r");
+  if (!fp) {
+    return -1;
+  }
+  int lines = 0;
+  char line[256];
+  while (fgets(line, sizeof(line), fp)) {
+    lines++;
+  }
+  fclose(fp);
+  return lines;
+}
+
+void writeSegments(const std::string& base) {
+  runlog log;
+  CHECK(log.open(base, runheader()));
+  uint32_t written = 0;
+  for (int k = 0; k < rows; k++) {
+    written += log.add(sample(k));
+  }
+  written += log.close();
+  CHECK(written == (uint32_t)rows);
+  CHECK(std::filesystem::exists(runlog::segmentPath(base, 2)));
+  CHECK(!std::filesystem::exists(runlog::segmentPath(base, 3)));
+
+  std::vector<runindexentry> index;
+  CHECK(runlog::loadIndex(base, index));
+  uint32_t indexed = 0;
+  for (const runindexentry& e : index) {
+    indexed += e.count;
+  }
+  CHECK(indexed == (uint32_t)rows);
+  CHECK(!index.empty() && index.front().segment == 0 &&
+        index.back().segment == 2);
+  // Each segment holds at most an hour.
+  for (const runindexentry& e : index) {
+    CHECK(e.time_max - (100.0 + e.segment * runlog::segment_seconds) <
+          runlog::segment_seconds);
+  }
+}
+
+// A range across a segment boundary comes back whole and in order.
+void readRange(const std::string& base) {
+  runcolumns out;
+  CHECK(runlog::read(base, 3600.0, 3800.0, out));
+  CHECK(out.time.size() == 201);
+  bool same = out.time.size() == 201;
+  for (size_t i = 0; same && i < out.time.size(); i++) {
+    const logrecord r = sample(3500 + (int)i);
+    same = fabs(out.time[i] - r.time) < 1e-6 && out.voltage[i] == r.voltage &&
+           out.current[i] == r.current;
+  }
+  CHECK(same);
+}
+
+// A lost index is rebuilt from the segments.
+void rebuildIndex(const std::string& base) {
+  std::vector<runindexentry> before;
+  CHECK(runlog::loadIndex(base, before));
+  std::filesystem::remove(runlog::indexPath(base));
+  std::vector<runindexentry> after;
+  CHECK(runlog::loadIndex(base, after));
+  CHECK(after.size() == before.size());
+  CHECK(!after.empty() && after.back().offset == before.back().offset);
+}
+
+// A reopened run continues its last segment.
+void resume(const std::string& base) {
+  {
+    runlog log;
+    CHECK(log.open(base, runheader()));
+    for (int k = rows; k < rows + 30; k++) {
+      log.add(sample(k));
+    }
+  }
+  CHECK(!std::filesystem::exists(runlog::segmentPath(base, 3)));
+  runcolumns out;
+  CHECK(runlog::read(base, 100.0 + rows, 1e9, out));
+  CHECK(out.time.size() == 30);
+}
+
+// A missing segment fails the export, and the CSV ends before it.
+void missingSegment(const std::string& base, const std::string& csv) {
+  CHECK(runlog::exportCsv(base, csv));
+  CHECK(countLines(csv) == 1 + rows + 30);
+  std::vector<runindexentry> index;
+  CHECK(runlog::loadIndex(base, index));
+  uint32_t before = 0;
+  for (const runindexentry& e : index) {
+    before += e.segment < 1 ? e.count : 0;
+  }
+  std::filesystem::remove(runlog::segmentPath(base, 1));
+  CHECK(!runlog::exportCsv(base, csv));
+  CHECK(countLines(csv) == 1 + (int)before);
+  runcolumns out;
+  CHECK(!runlog::read(base, 0.0, 1e9, out));
+}
+}  // namespace
+
+int main() {
+  const std::filesystem::path dir =
+      std::filesystem::temp_directory_path() / "runlog_test";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  const std::string base = (dir / "data").string();
+  writeSegments(base);
+  readRange(base);
+  rebuildIndex(base);
+  resume(base);
+  missingSegment(base, (dir / "data.csv").string());
+  std::filesystem::remove_all(dir);
+  return report("runlog_test");
+}
@@ -0,0 +1,121 @@
+﻿// The termios and TCP SCPI backends; Linux only, the VISA backend needs the
+// lab hardware.
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "check.hpp"
+#include "scpitransport.hpp"
+
+namespace {
+// Loopback listener on a free port.
+int listenLocal(int& port) {
+  const int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t length = sizeof(addr);
+  if (fd < 0 || bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0 ||
+      listen(fd, 1) != 0 ||
+      getsockname(fd, (sockaddr*)&addr, &length) != 0) {
+    return -1;
+  }
+  port = ntohs(addr.sin_port);
+  return fd;
+}
+
+std::string resource(int port) {
+  return "TCPIP0::127.0.0.1::" + std::to_string(port) + "::SOCKET";
+}
+
+// Replies arrive in pieces, several at once and over-long; all are split
+// into lines at '\n' with a trailing '\r' dropped.
+void tcpLines() {
+  int port = 0;
+  const int server = listenLocal(port);
+  CHECK(server >= 0);
+  std::string received;
+  std::thread peer([server, &received]() {
+    const int fd = accept(server, NULL, NULL);
+    char buf[64];
+    const ssize_t n = read(fd, buf, sizeof(buf));
+    received.assign(buf, n > 0 ? n : 0);
+    const char* parts[] = {"12.", "5\r\n", "0.25\n1.5\n",
+                           "0123456789ABCDEF\n"};
+    for (const char* part : parts) {
+      if (write(fd, part, strlen(part)) < 0) {
+        break;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    close(fd);
+  });
+  std::unique_ptr<scpitransport> t(scpitransport::open(
+      resource(port).c_str()));
+  CHECK(t != nullptr);
+  if (t) {
+    CHECK(t->write("MEAS:VOLT?\n", 11));
+    char line[8];
+    CHECK(t->readLine(line, sizeof(line)) == 4 && !strcmp(line, "12.5"));
+    CHECK(t->readLine(line, sizeof(line)) == 4 && !strcmp(line, "0.25"));
+    CHECK(t->readLine(line, sizeof(line)) == 3 && !strcmp(line, "1.5"));
+    CHECK(t->readLine(line, sizeof(line)) == 7 && !strcmp(line, "0123456"));
+    // The peer has hung up: an error, not a wait for the timeout.
+    const auto begin = std::chrono::steady_clock::now();
+    CHECK(t->readLine(line, sizeof(line)) == -1);
+    CHECK(std::chrono::steady_clock::now() - begin <
+          std::chrono::seconds(1));
+  }
+  peer.join();
+  CHECK(received == "MEAS:VOLT?\n");
+  close(server);
+}
+
+void badResources() {
+  CHECK(scpitransport::open("TCPIP0::127.0.0.1") == nullptr);
+  int port = 0;
+  const int server = listenLocal(port);
+  close(server);
+  CHECK(scpitransport::open(resource(port).c_str()) == nullptr);
+  CHECK(scpitransport::open("/dev/nonexistent-scpi-port") == nullptr);
+}
+
+// The serial backend on a pseudo-terminal, addressed VISA-style.
+void serialLines() {
+  const int master = posix_openpt(O_RDWR | O_NOCTTY);
+  CHECK(master >= 0 && grantpt(master) == 0 && unlockpt(master) == 0);
+  if (master < 0) {
+    return;
+  }
+  const std::string name = std::string("ASRL") + ptsname(master) + "::INSTR";
+  std::unique_ptr<scpitransport> t(scpitransport::open(name.c_str()));
+  CHECK(t != nullptr);
+  if (t) {
+    CHECK(t->write("*IDN?\n", 6));
+    char buf[16];
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    const ssize_t n = read(master, buf, sizeof(buf));
+    CHECK(n == 6 && !memcmp(buf, "*IDN?\n", 6));
+    CHECK(write(master, "PSW,1\r\n", 7) == 7);
+    char line[16];
+    CHECK(t->readLine(line, sizeof(line)) == 5 && !strcmp(line, "PSW,1"));
+  }
+  close(master);
+}
+}  // namespace
+
+int main() {
+  tcpLines();
+  badResources();
+  serialLines();
+  return report("scpi_test");
+}